@@ -0,0 +1,119 @@
+// chip8-analyze: static control flow recovery and disassembly for chip8 roms
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+
+#include "analyzer.h"
+#include "decode.h"
+#include "quirks.h"
+
+static constexpr size_t MEMORY_SIZE = 65536;
+static constexpr uint16_t ENTRY = 0x200;
+
+static void printData(const std::vector<uint8_t>& ram, size_t addr) {
+    // data is almost always sprites, so show the bits too
+    std::string bits;
+    for (int b = 7; b >= 0; b--) bits += (ram[addr] >> b) & 1 ? '#' : '.';
+    printf("  %04zX: %02X          db 0x%02X        ; %s\n", addr, ram[addr], ram[addr], bits.c_str());
+}
+
+int main(int argc, char** argv) {
+    std::string filename;
+    std::string quirksName;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--quirks" && i + 1 < argc) {
+            quirksName = argv[++i];
+        } else {
+            filename = arg;
+        }
+    }
+
+    if (filename.empty()) {
+        std::cerr << "usage: chip8-analyze <rom> [--quirks vip|chip48|schip|xochip]\n";
+        return 1;
+    }
+
+    QuirkProfile profile = detectQuirkProfile(filename);
+    if (!quirksName.empty()) {
+        auto parsed = parseQuirkProfile(quirksName);
+        if (!parsed) {
+            std::cerr << "Unknown quirk profile " << quirksName << "\n";
+            return 1;
+        }
+        profile = *parsed;
+    }
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Failed to open file " << filename << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (rom.size() > MEMORY_SIZE - ENTRY) {
+        std::cerr << "Error: ROM too large to fit in memory!" << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> ram(MEMORY_SIZE, 0);
+    std::copy(rom.begin(), rom.end(), ram.begin() + ENTRY);
+    size_t end = ENTRY + rom.size();
+
+    RomAnalysis analysis = analyzeRom(ram, ENTRY, profile);
+    const auto& flags = analysis.flags;
+
+    printf("; %s, %s quirks, %zu bytes\n", filename.c_str(), quirkProfileName(profile), rom.size());
+    printf("; %zu blocks, %zu bytes of code, %zu bytes of data\n\n",
+           analysis.blocks.size(), analysis.codeBytes, rom.size() > analysis.codeBytes ? rom.size() - analysis.codeBytes : 0);
+
+    // code can jump outside the rom (into the font, or ram it wrote itself), so list
+    // everything reachable plus the whole rom image
+    QuirkInfo info = quirkInfo(profile);
+    for (size_t addr = 0; addr < MEMORY_SIZE;) {
+        bool inRom = addr >= ENTRY && addr < end;
+        if (flags[addr] & ADDR_CODE) {
+            if (flags[addr] & ADDR_BLOCK_START) {
+                const char* kind = (flags[addr] & ADDR_CALL_TARGET) ? "sub" : "block";
+                printf("%s_%04zX:\n", kind, addr);
+            }
+            uint16_t op = (ram[addr] << 8) | ram[(addr + 1) % MEMORY_SIZE];
+            uint16_t next = (ram[(addr + 2) % MEMORY_SIZE] << 8) | ram[(addr + 3) % MEMORY_SIZE];
+            std::string text = disassemble(op, next, profile);
+            printf("  %04zX: %04X        %s\n", addr, op, text.c_str());
+            addr += decode(op, info.superChip, info.xoChip) == OP_F000 ? 4 : 2;
+            continue;
+        }
+        if (inRom && !(flags[addr] & ADDR_OPERAND)) {
+            if (flags[addr] & ADDR_DATA) printf("data_%04zX:\n", addr);
+            printData(ram, addr);
+        }
+        addr++;
+    }
+
+    printf("\n; control flow graph\n");
+    for (const BasicBlock& block : analysis.blocks) {
+        printf(";   %04X-%04X ->", block.start, block.end - 2);
+        if (block.successors.empty()) printf(" (exit)");
+        for (uint16_t succ : block.successors) printf(" %04X", succ);
+        printf("\n");
+    }
+
+    printf("\n; self-modifying code\n");
+    if (analysis.selfModifying.empty()) printf(";   none found\n");
+    for (const CodeWrite& write : analysis.selfModifying) {
+        uint16_t op = (ram[write.pc] << 8) | ram[write.pc + 1];
+        printf(";   %04X: %s writes %04X-%04X\n", write.pc, disassemble(op, 0, profile).c_str(),
+               write.target, write.target + write.length - 1);
+    }
+
+    printf("\n; indirect jumps\n");
+    if (analysis.indirectJumps.empty()) printf(";   none found\n");
+    for (uint16_t pc : analysis.indirectJumps) {
+        uint16_t op = (ram[pc] << 8) | ram[pc + 1];
+        printf(";   %04X: %s\n", pc, disassemble(op, 0, profile).c_str());
+    }
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "analyzer.h"
+#include "decode.h"
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+struct Pending {
+    uint16_t addr;
+    int knownI;   // value of i on entry if it's a constant, -1 otherwise
+};
+
+bool isSkip(OpKind kind) {
+    return kind == OP_3XNN || kind == OP_4XNN || kind == OP_5XY0 || kind == OP_9XY0
+        || kind == OP_EX9E || kind == OP_EXA1;
+}
+
+// instructions that end a basic block
+bool endsBlock(OpKind kind) {
+    return isSkip(kind) || kind == OP_1NNN || kind == OP_2NNN || kind == OP_BNNN
+        || kind == OP_00EE || kind == OP_00FD || kind == OP_UNKNOWN;
+}
+
+uint16_t word(std::span<const uint8_t> ram, size_t addr) {
+    if (addr + 1 >= ram.size()) return 0;
+    return (ram[addr] << 8) | ram[addr + 1];
+}
+
+size_t length(OpKind kind) {
+    return kind == OP_F000 ? 4 : 2;
+}
+
+} // namespace
+
+RomAnalysis analyzeRom(std::span<const uint8_t> ram, uint16_t entry, QuirkProfile profile) {
+    QuirkInfo info = quirkInfo(profile);
+    RomAnalysis result;
+    result.flags.assign(ram.size(), 0);
+    auto& flags = result.flags;
+
+    std::vector<Pending> worklist = {{entry, -1}};
+    std::vector<CodeWrite> writes;
+    flags[entry] |= ADDR_BLOCK_START;
+
+    auto branchTo = [&](size_t target, uint8_t kindFlag, int knownI) {
+        if (target + 1 >= ram.size()) return;
+        flags[target] |= ADDR_BLOCK_START | kindFlag;
+        worklist.push_back({(uint16_t)target, knownI});
+    };
+
+    while (!worklist.empty()) {
+        Pending next = worklist.back();
+        worklist.pop_back();
+
+        size_t addr = next.addr;
+        int knownI = next.knownI;
+        while (addr + 1 < ram.size() && !(flags[addr] & ADDR_CODE)) {
+            uint16_t op = word(ram, addr);
+            OpKind kind = decode(op, info.superChip, info.xoChip);
+            size_t len = length(kind);
+            uint8_t x = (op & 0x0F00) >> 8;
+            uint8_t y = (op & 0x00F0) >> 4;
+
+            flags[addr] |= ADDR_CODE;
+            for (size_t i = 1; i < len && addr + i < ram.size(); i++) flags[addr + i] |= ADDR_OPERAND;
+            size_t fallthrough = addr + len;
+
+            switch (kind) {
+                case OP_ANNN: knownI = op & 0x0FFF; break;
+                case OP_F000: knownI = word(ram, addr + 2); break;
+                case OP_FX1E: case OP_FX29: case OP_FX30: knownI = -1; break;
+                case OP_FX33:
+                    if (knownI >= 0) writes.push_back({(uint16_t)addr, (uint16_t)knownI, 3});
+                    break;
+                case OP_FX55:
+                    if (knownI >= 0) writes.push_back({(uint16_t)addr, (uint16_t)knownI, (uint16_t)(x + 1)});
+                    // the index increment quirk moves i, don't guess which way
+                    knownI = -1;
+                    break;
+                case OP_FX65: knownI = -1; break;
+                case OP_5XY2:
+                    if (knownI >= 0) writes.push_back({(uint16_t)addr, (uint16_t)knownI, (uint16_t)(abs(x - y) + 1)});
+                    break;
+                default: break;
+            }
+
+            if (kind == OP_1NNN) {
+                branchTo(op & 0x0FFF, ADDR_JUMP_TARGET, knownI);
+            } else if (kind == OP_2NNN) {
+                branchTo(op & 0x0FFF, ADDR_CALL_TARGET, -1);
+                branchTo(fallthrough, 0, -1);
+            } else if (kind == OP_BNNN) {
+                // the target depends on a register, keep the base as the most likely entry
+                result.indirectJumps.push_back(addr);
+                branchTo(op & 0x0FFF, ADDR_JUMP_TARGET, knownI);
+            } else if (isSkip(kind)) {
+                size_t skipped = fallthrough + length(decode(word(ram, fallthrough), info.superChip, info.xoChip));
+                branchTo(fallthrough, 0, knownI);
+                branchTo(skipped, ADDR_JUMP_TARGET, knownI);
+            }
+            if (endsBlock(kind)) break;
+            addr = fallthrough;
+        }
+    }
+
+    // ANNN/F000 targets that didn't turn out to be code are data (usually sprites)
+    for (size_t addr = 0; addr + 1 < ram.size(); addr++) {
+        if (!(flags[addr] & ADDR_CODE)) continue;
+        uint16_t op = word(ram, addr);
+        OpKind kind = decode(op, info.superChip, info.xoChip);
+        size_t target = kind == OP_ANNN ? (op & 0x0FFF) : kind == OP_F000 ? word(ram, addr + 2) : ram.size();
+        if (target < ram.size() && !(flags[target] & (ADDR_CODE | ADDR_OPERAND))) flags[target] |= ADDR_DATA;
+    }
+
+    for (const CodeWrite& write : writes) {
+        for (size_t i = 0; i < write.length; i++) {
+            size_t target = write.target + i;
+            if (target < ram.size() && (flags[target] & (ADDR_CODE | ADDR_OPERAND))) {
+                result.selfModifying.push_back(write);
+                break;
+            }
+        }
+    }
+
+    // cut the code into basic blocks: a block runs until a control flow instruction,
+    // a gap, or the next leader
+    BasicBlock* current = nullptr;
+    for (size_t addr = 0; addr + 1 < ram.size();) {
+        if (!(flags[addr] & ADDR_CODE)) {
+            current = nullptr;
+            addr++;
+            continue;
+        }
+        if (!current || (flags[addr] & ADDR_BLOCK_START)) {
+            if (current) current->successors.push_back(addr);
+            result.blocks.push_back({(uint16_t)addr, (uint16_t)addr, {}});
+            current = &result.blocks.back();
+        }
+
+        uint16_t op = word(ram, addr);
+        OpKind kind = decode(op, info.superChip, info.xoChip);
+        size_t len = length(kind);
+        size_t fallthrough = addr + len;
+        result.codeBytes += len;
+        current->end = fallthrough;
+
+        if (endsBlock(kind)) {
+            if (kind == OP_1NNN || kind == OP_2NNN || kind == OP_BNNN) current->successors.push_back(op & 0x0FFF);
+            if (kind == OP_2NNN) current->successors.push_back(fallthrough);
+            if (isSkip(kind)) {
+                current->successors.push_back(fallthrough);
+                current->successors.push_back(fallthrough + length(decode(word(ram, fallthrough), info.superChip, info.xoChip)));
+            }
+            current = nullptr;
+        }
+        addr = fallthrough;
+    }
+
+    return result;
+}
+
+std::string disassemble(uint16_t op, uint16_t next, QuirkProfile profile) {
+    QuirkInfo info = quirkInfo(profile);
+    unsigned x = (op & 0x0F00) >> 8;
+    unsigned y = (op & 0x00F0) >> 4;
+    unsigned n = op & 0x000F;
+    unsigned nn = op & 0x00FF;
+    unsigned nnn = op & 0x0FFF;
+
+    char text[48];
+    switch (decode(op, info.superChip, info.xoChip)) {
+        case OP_00E0: return "CLS";
+        case OP_00EE: return "RET";
+        case OP_00CN: snprintf(text, sizeof(text), "SCD %u", n); break;
+        case OP_00DN: snprintf(text, sizeof(text), "SCU %u", n); break;
+        case OP_00FB: return "SCR";
+        case OP_00FC: return "SCL";
+        case OP_00FD: return "EXIT";
+        case OP_00FE: return "LOW";
+        case OP_00FF: return "HIGH";
+        case OP_1NNN: snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+        case OP_2NNN: snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+        case OP_3XNN: snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, nn); break;
+        case OP_4XNN: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, nn); break;
+        case OP_5XY0: snprintf(text, sizeof(text), "SE V%X, V%X", x, y); break;
+        case OP_5XY2: snprintf(text, sizeof(text), "SAVE V%X-V%X", x, y); break;
+        case OP_5XY3: snprintf(text, sizeof(text), "LOAD V%X-V%X", x, y); break;
+        case OP_6XNN: snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, nn); break;
+        case OP_7XNN: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, nn); break;
+        case OP_8XY0: snprintf(text, sizeof(text), "LD V%X, V%X", x, y); break;
+        case OP_8XY1: snprintf(text, sizeof(text), "OR V%X, V%X", x, y); break;
+        case OP_8XY2: snprintf(text, sizeof(text), "AND V%X, V%X", x, y); break;
+        case OP_8XY3: snprintf(text, sizeof(text), "XOR V%X, V%X", x, y); break;
+        case OP_8XY4: snprintf(text, sizeof(text), "ADD V%X, V%X", x, y); break;
+        case OP_8XY5: snprintf(text, sizeof(text), "SUB V%X, V%X", x, y); break;
+        case OP_8XY6: snprintf(text, sizeof(text), "SHR V%X, V%X", x, y); break;
+        case OP_8XY7: snprintf(text, sizeof(text), "SUBN V%X, V%X", x, y); break;
+        case OP_8XYE: snprintf(text, sizeof(text), "SHL V%X, V%X", x, y); break;
+        case OP_9XY0: snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); break;
+        case OP_ANNN: snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+        case OP_BNNN: snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+        case OP_CXNN: snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, nn); break;
+        case OP_DXYN: snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); break;
+        case OP_EX9E: snprintf(text, sizeof(text), "SKP V%X", x); break;
+        case OP_EXA1: snprintf(text, sizeof(text), "SKNP V%X", x); break;
+        case OP_F000: snprintf(text, sizeof(text), "LD I, long 0x%04X", next); break;
+        case OP_FN01: snprintf(text, sizeof(text), "PLANE %u", x); break;
+        case OP_F002: return "AUDIO";
+        case OP_FX07: snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+        case OP_FX0A: snprintf(text, sizeof(text), "LD V%X, K", x); break;
+        case OP_FX15: snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+        case OP_FX18: snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+        case OP_FX1E: snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+        case OP_FX29: snprintf(text, sizeof(text), "LD F, V%X", x); break;
+        case OP_FX30: snprintf(text, sizeof(text), "LD HF, V%X", x); break;
+        case OP_FX33: snprintf(text, sizeof(text), "LD B, V%X", x); break;
+        case OP_FX3A: snprintf(text, sizeof(text), "PITCH V%X", x); break;
+        case OP_FX55: snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+        case OP_FX65: snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+        case OP_FX75: snprintf(text, sizeof(text), "LD R, V%X", x); break;
+        case OP_FX85: snprintf(text, sizeof(text), "LD V%X, R", x); break;
+        case OP_NOP: snprintf(text, sizeof(text), "SYS 0x%03X", nnn); break;
+        default: snprintf(text, sizeof(text), "??? 0x%04X", op); break;
+    }
+    return text;
+}
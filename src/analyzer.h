@@ -0,0 +1,52 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "quirks.h"
+
+// static rom analysis. walks every path reachable from the entry point (jumps, calls and
+// both sides of skips) to split code from data, which the runtime uses as a hint table
+// to decode instructions once at load time, and chip8-analyze uses for disassembly
+
+// per address flags
+enum : uint8_t {
+    ADDR_CODE = 1 << 0,         // first byte of a reachable instruction
+    ADDR_OPERAND = 1 << 1,      // the rest of an instruction (low byte, F000 address word)
+    ADDR_DATA = 1 << 2,         // pointed at by an ANNN / F000 NNNN load
+    ADDR_BLOCK_START = 1 << 3,  // basic block leader
+    ADDR_JUMP_TARGET = 1 << 4,
+    ADDR_CALL_TARGET = 1 << 5,
+};
+
+struct BasicBlock {
+    uint16_t start;
+    uint16_t end;   // address right after the last instruction
+    std::vector<uint16_t> successors;
+};
+
+// FX55/FX33/5XY2 with a known i that writes over reachable code
+struct CodeWrite {
+    uint16_t pc;
+    uint16_t target;
+    uint16_t length;
+};
+
+struct RomAnalysis {
+    std::vector<uint8_t> flags;
+    std::vector<BasicBlock> blocks;
+    std::vector<CodeWrite> selfModifying;
+    std::vector<uint16_t> indirectJumps;
+    size_t codeBytes = 0;
+};
+
+// ram is the whole address space with the rom already loaded at `entry`
+RomAnalysis analyzeRom(std::span<const uint8_t> ram, uint16_t entry, QuirkProfile profile);
+
+// one instruction in the usual mnemonic style, `next` is only used by F000 NNNN
+std::string disassemble(uint16_t op, uint16_t next, QuirkProfile profile);
+
+#endif // ANALYZER_H
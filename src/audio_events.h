@@ -0,0 +1,26 @@
+#ifndef AUDIO_EVENTS_H
+#define AUDIO_EVENTS_H
+
+#include <array>
+#include <cstdint>
+#include "spsc_ring.h"
+
+// what the core tells the audio side, stamped with the emulated cycle it happened on so
+// the synth can place it at the exact sample regardless of host scheduling
+struct AudioEvent {
+    enum Type : uint8_t {
+        GATE_ON,
+        GATE_OFF,
+        PITCH,      // xo-chip FX3A
+        PATTERN     // xo-chip F002
+    };
+
+    uint64_t cycle;
+    Type type;
+    uint8_t pitch;
+    std::array<uint8_t, 16> pattern;
+};
+
+using AudioEventQueue = SpscRing<AudioEvent, 256>;
+
+#endif // AUDIO_EVENTS_H
@@ -0,0 +1,371 @@
+#include "batch.h"
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+Chip8Batch::Chip8Batch(const Chip8& prototype, size_t lanes, uint64_t seedValue) : lanes(lanes) {
+    QuirkInfo info = quirkInfo(prototype.quirks);
+    if (info.superChip || info.xoChip) {
+        throw std::invalid_argument("batch engine only runs vip/chip48 roms");
+    }
+    switch (prototype.quirks) {
+        case QuirkProfile::CHIP48: runFn = &Chip8Batch::run<QuirksCHIP48>; break;
+        default: runFn = &Chip8Batch::run<QuirksVIP>; break;
+    }
+
+    std::copy(prototype.v_reg.begin(), prototype.v_reg.end(), initV.begin());
+    std::copy(prototype.ram.begin(), prototype.ram.begin() + MEMORY_SIZE, initRam.begin());
+    initStack = prototype.stack;
+    initI = prototype.i_reg;
+    initPc = prototype.pc;
+    initSp = prototype.sp;
+    initDt = prototype.dt;
+    initSt = prototype.st;
+
+    codeMap.assign(MEMORY_SIZE, 0);
+    for (size_t addr = 0; addr < MEMORY_SIZE; addr++) {
+        // fused entries keep the plain ones after them, so every instruction has its own entry
+        if (prototype.translated[addr] == OP_NONE) continue;
+        codeMap[addr] = 1;
+        if (addr + 1 < MEMORY_SIZE) codeMap[addr + 1] = 1;
+    }
+
+    for (auto& reg : v) reg.assign(lanes, 0);
+    i_reg.assign(lanes, 0);
+    pc.assign(lanes, 0);
+    sp.assign(lanes, 0);
+    dt.assign(lanes, 0);
+    st.assign(lanes, 0);
+    stack.assign(Chip8::STACK_SIZE * lanes, 0);
+    keypad.assign(lanes, 0);
+    waitingKey.assign(lanes, 0xFF);
+    ram.assign(MEMORY_SIZE * lanes, 0);
+    framebuffer.assign(HEIGHT * lanes, 0);
+    codeDirty.assign(lanes, 0);
+    rng.assign(lanes, 0);
+
+    for (size_t lane = 0; lane < lanes; lane++) {
+        reset(lane);
+        seed(lane, seedValue + lane);
+    }
+}
+
+void Chip8Batch::reset(size_t lane) {
+    for (size_t r = 0; r < Chip8::REGS; r++) v[r][lane] = initV[r];
+    for (size_t d = 0; d < Chip8::STACK_SIZE; d++) stack[d * lanes + lane] = initStack[d];
+    i_reg[lane] = initI;
+    pc[lane] = initPc;
+    sp[lane] = initSp;
+    dt[lane] = initDt;
+    st[lane] = initSt;
+    keypad[lane] = 0;
+    waitingKey[lane] = 0xFF;
+    std::copy(initRam.begin(), initRam.end(), ram.begin() + lane * MEMORY_SIZE);
+    std::fill(framebuffer.begin() + lane * HEIGHT, framebuffer.begin() + (lane + 1) * HEIGHT, 0);
+    codeDirty[lane] = 0;
+}
+
+void Chip8Batch::seed(size_t lane, uint64_t value) {
+    // splitmix so neighbouring seeds don't give neighbouring streams, xorshift can't start at 0
+    uint64_t z = value + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    rng[lane] = z ? z : 1;
+}
+
+void Chip8Batch::tickTimers() {
+    for (size_t lane = 0; lane < lanes; lane++) {
+        dt[lane] -= dt[lane] > 0;
+        st[lane] -= st[lane] > 0;
+    }
+}
+
+void Chip8Batch::writeRam(size_t lane, uint16_t addr, uint8_t val) {
+    addr &= MEMORY_SIZE - 1;
+    ram[lane * MEMORY_SIZE + addr] = val;
+    if (codeMap[addr]) codeDirty[lane] = 1;
+}
+
+template <typename Q>
+void Chip8Batch::draw(uint16_t op, size_t lane) {
+    uint8_t x_coord = v[(op & 0x0F00) >> 8][lane] & (WIDTH - 1);
+    uint8_t y_coord = v[(op & 0x00F0) >> 4][lane] & (HEIGHT - 1);
+    uint8_t height = op & 0x000F;
+    const uint8_t* mem = &ram[lane * MEMORY_SIZE];
+    uint64_t* rows = &framebuffer[lane * HEIGHT];
+    uint8_t collision = 0;
+
+    for (uint8_t row = 0; row < height; row++) {
+        size_t y = y_coord + row;
+        if constexpr (Q::wrapSprites) {
+            y &= HEIGHT - 1;
+        } else {
+            if (y >= HEIGHT) break;
+        }
+        uint64_t sprite = uint64_t(mem[(i_reg[lane] + row) & (MEMORY_SIZE - 1)]) << 56;
+        uint64_t placed = sprite >> x_coord;
+        if constexpr (Q::wrapSprites) {
+            if (x_coord > WIDTH - 8) placed |= sprite << (WIDTH - x_coord);
+        }
+        collision |= (rows[y] & placed) != 0;
+        rows[y] ^= placed;
+    }
+    v[0xF][lane] = collision;
+}
+
+// one instruction for lanes [begin, end), which all fetched `op`. the lockstep path passes
+// every lane, the scalar path one at a time. the per-lane loops are written so the
+// compiler can vectorize them over the byte/word arrays
+template <typename Q>
+void Chip8Batch::execute(OpKind kind, uint16_t op, size_t begin, size_t end) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    uint8_t y = (op & 0x00F0) >> 4;
+    uint8_t nn = op & 0x00FF;
+    uint16_t nnn = op & 0x0FFF;
+    uint8_t* vx = v[x].data();
+    uint8_t* vy = v[y].data();
+    uint8_t* vf = v[0xF].data();
+    uint16_t* pcs = pc.data();
+
+    for (size_t l = begin; l < end; l++) pcs[l] += 2;
+
+    switch (kind) {
+        case OP_00E0:
+            for (size_t l = begin; l < end; l++) {
+                std::fill(&framebuffer[l * HEIGHT], &framebuffer[(l + 1) * HEIGHT], 0);
+            }
+            break;
+        case OP_00EE:
+            for (size_t l = begin; l < end; l++) {
+                // same as Chip8::pop with the wrap policy, an empty stack wraps to the top
+                sp[l] = (sp[l] - 1) & (Chip8::STACK_SIZE - 1);
+                pcs[l] = stack[sp[l] * lanes + l];
+            }
+            break;
+        case OP_1NNN:
+            for (size_t l = begin; l < end; l++) pcs[l] = nnn;
+            break;
+        case OP_2NNN:
+            for (size_t l = begin; l < end; l++) {
+                stack[(sp[l] & (Chip8::STACK_SIZE - 1)) * lanes + l] = pcs[l];
+                sp[l] = (sp[l] + 1) & (Chip8::STACK_SIZE - 1);
+                pcs[l] = nnn;
+            }
+            break;
+        case OP_3XNN:
+            for (size_t l = begin; l < end; l++) pcs[l] += vx[l] == nn ? 2 : 0;
+            break;
+        case OP_4XNN:
+            for (size_t l = begin; l < end; l++) pcs[l] += vx[l] != nn ? 2 : 0;
+            break;
+        case OP_5XY0:
+            for (size_t l = begin; l < end; l++) pcs[l] += vx[l] == vy[l] ? 2 : 0;
+            break;
+        case OP_9XY0:
+            for (size_t l = begin; l < end; l++) pcs[l] += vx[l] != vy[l] ? 2 : 0;
+            break;
+        case OP_6XNN:
+            for (size_t l = begin; l < end; l++) vx[l] = nn;
+            break;
+        case OP_7XNN:
+            for (size_t l = begin; l < end; l++) vx[l] += nn;
+            break;
+        case OP_8XY0:
+            for (size_t l = begin; l < end; l++) vx[l] = vy[l];
+            break;
+        case OP_8XY1:
+            for (size_t l = begin; l < end; l++) vx[l] |= vy[l];
+            if constexpr (Q::vfReset) for (size_t l = begin; l < end; l++) vf[l] = 0;
+            break;
+        case OP_8XY2:
+            for (size_t l = begin; l < end; l++) vx[l] &= vy[l];
+            if constexpr (Q::vfReset) for (size_t l = begin; l < end; l++) vf[l] = 0;
+            break;
+        case OP_8XY3:
+            for (size_t l = begin; l < end; l++) vx[l] ^= vy[l];
+            if constexpr (Q::vfReset) for (size_t l = begin; l < end; l++) vf[l] = 0;
+            break;
+        // the flag ops keep Chip8's order (result first, then vf) so x or y == f behaves the same
+        case OP_8XY4:
+            for (size_t l = begin; l < end; l++) {
+                unsigned sum = vx[l] + vy[l];
+                vx[l] = sum;
+                vf[l] = sum > 0xFF;
+            }
+            break;
+        case OP_8XY5:
+            for (size_t l = begin; l < end; l++) {
+                uint8_t a = vx[l];
+                vx[l] = a - vy[l];
+                vf[l] = a >= vy[l];
+            }
+            break;
+        case OP_8XY6:
+            for (size_t l = begin; l < end; l++) {
+                uint8_t a = Q::shiftVY ? vy[l] : vx[l];
+                vx[l] = a >> 1;
+                vf[l] = a & 1;
+            }
+            break;
+        case OP_8XY7:
+            for (size_t l = begin; l < end; l++) {
+                uint8_t a = vx[l];
+                vx[l] = vy[l] - a;
+                vf[l] = vy[l] >= a;
+            }
+            break;
+        case OP_8XYE:
+            for (size_t l = begin; l < end; l++) {
+                uint8_t a = Q::shiftVY ? vy[l] : vx[l];
+                vx[l] = a << 1;
+                vf[l] = a >> 7;
+            }
+            break;
+        case OP_ANNN:
+            for (size_t l = begin; l < end; l++) i_reg[l] = nnn;
+            break;
+        case OP_BNNN:
+            for (size_t l = begin; l < end; l++) pcs[l] = nnn + (Q::jumpVX ? vx[l] : v[0][l]);
+            break;
+        case OP_CXNN:
+            for (size_t l = begin; l < end; l++) {
+                uint64_t s = rng[l];
+                s ^= s << 13;
+                s ^= s >> 7;
+                s ^= s << 17;
+                rng[l] = s;
+                vx[l] = (uint8_t)s & nn;
+            }
+            break;
+        case OP_DXYN:
+            for (size_t l = begin; l < end; l++) draw<Q>(op, l);
+            break;
+        case OP_EX9E:
+            for (size_t l = begin; l < end; l++) pcs[l] += (keypad[l] >> (vx[l] & 0xF)) & 1 ? 2 : 0;
+            break;
+        case OP_EXA1:
+            for (size_t l = begin; l < end; l++) pcs[l] += (keypad[l] >> (vx[l] & 0xF)) & 1 ? 0 : 2;
+            break;
+        case OP_FX07:
+            for (size_t l = begin; l < end; l++) vx[l] = dt[l];
+            break;
+        case OP_FX0A:
+            // wait for a key to go down and come back up, like the vip
+            for (size_t l = begin; l < end; l++) {
+                if (waitingKey[l] == 0xFF) {
+                    // lowest key held, same pick as Chip8::opcode_FX0A
+                    if (keypad[l]) waitingKey[l] = std::countr_zero(keypad[l]);
+                    pcs[l] -= 2;
+                } else if ((keypad[l] >> waitingKey[l]) & 1) {
+                    pcs[l] -= 2;
+                } else {
+                    vx[l] = waitingKey[l];
+                    waitingKey[l] = 0xFF;
+                }
+            }
+            break;
+        case OP_FX15:
+            for (size_t l = begin; l < end; l++) dt[l] = vx[l];
+            break;
+        case OP_FX18:
+            // no audio out of the batch, the timer still runs so FX07-style polling works
+            for (size_t l = begin; l < end; l++) st[l] = vx[l];
+            break;
+        case OP_FX1E:
+            for (size_t l = begin; l < end; l++) i_reg[l] += vx[l];
+            break;
+        case OP_FX29:
+            for (size_t l = begin; l < end; l++) i_reg[l] = Chip8::FONT_ADDR + (vx[l] & 0xF) * 5;
+            break;
+        case OP_FX33:
+            for (size_t l = begin; l < end; l++) {
+                uint8_t val = vx[l];
+                writeRam(l, i_reg[l], val / 100);
+                writeRam(l, i_reg[l] + 1, (val / 10) % 10);
+                writeRam(l, i_reg[l] + 2, val % 10);
+            }
+            break;
+        case OP_FX55:
+            for (size_t l = begin; l < end; l++) {
+                for (uint8_t r = 0; r <= x; r++) writeRam(l, i_reg[l] + r, v[r][l]);
+                if constexpr (Q::memoryIncrement) i_reg[l] += x + 1;
+            }
+            break;
+        case OP_FX65:
+            for (size_t l = begin; l < end; l++) {
+                const uint8_t* mem = &ram[l * MEMORY_SIZE];
+                for (uint8_t r = 0; r <= x; r++) v[r][l] = mem[(i_reg[l] + r) & (MEMORY_SIZE - 1)];
+                if constexpr (Q::memoryIncrement) i_reg[l] += x + 1;
+            }
+            break;
+        default:
+            // 0NNN and anything unknown do nothing, thousands of lanes printing helps nobody
+            break;
+    }
+}
+
+template <typename Q>
+void Chip8Batch::run(int count) {
+    for (int i = 0; i < count; i++) {
+        // split the lanes into runs that sit at the same pc and fetch the same opcode there,
+        // each run decodes once. in lockstep that's a single run over everything, fully
+        // diverged it degrades to one lane at a time
+        size_t runs = 0;
+        for (size_t begin = 0; begin < lanes; runs++) {
+            const uint8_t* mem = &ram[begin * MEMORY_SIZE];
+            uint16_t addr = pc[begin] & (MEMORY_SIZE - 1);
+            uint16_t next = (addr + 1) & (MEMORY_SIZE - 1);
+            uint16_t op = (mem[addr] << 8) | mem[next];
+            size_t end = begin + 1;
+            if (codeMap[addr] && codeMap[next]) {
+                // analyzed code only differs between lanes once a lane wrote over it
+                if (!codeDirty[begin]) {
+                    while (end < lanes && pc[end] == pc[begin] && !codeDirty[end]) end++;
+                }
+            } else {
+                // anything else (BNNN targets, data, code built at runtime) can hold
+                // different bytes in every lane, compare the opcode itself
+                while (end < lanes && pc[end] == pc[begin]) {
+                    const uint8_t* other = &ram[end * MEMORY_SIZE];
+                    if (other[addr] != mem[addr] || other[next] != mem[next]) break;
+                    end++;
+                }
+            }
+            execute<Q>(decode(op, false, false), op, begin, end);
+            begin = end;
+        }
+        if (runs == 1) lockstepSteps++;
+        else divergedSteps++;
+    }
+}
+
+void Chip8Batch::benchmark(const Chip8& prototype, size_t lanes, int frames) {
+    using namespace std::chrono;
+    std::cout << "Batch benchmark, " << lanes << " lanes, " << frames << " frames" << std::endl;
+
+    std::vector<Chip8> machines(lanes, prototype);
+    auto start = high_resolution_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        for (Chip8& machine : machines) {
+            machine.runCycles(Chip8::INSTRUCTIONS_PER_FRAME);
+            machine.tickTimers();
+        }
+    }
+    double separate = duration<double>(high_resolution_clock::now() - start).count();
+
+    Chip8Batch batch(prototype, lanes);
+    start = high_resolution_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        batch.runCycles(Chip8::INSTRUCTIONS_PER_FRAME);
+        batch.tickTimers();
+    }
+    double batched = duration<double>(high_resolution_clock::now() - start).count();
+
+    double steps = double(lanes) * frames;
+    std::cout << "  separate Chip8s: " << steps / separate << " frames/s" << std::endl;
+    std::cout << "  batch:           " << steps / batched << " frames/s ("
+              << separate / batched << "x)" << std::endl;
+    std::cout << "  lockstep steps:  " << batch.lockstepSteps << ", diverged steps: " << batch.divergedSteps << std::endl;
+}
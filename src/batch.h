@@ -0,0 +1,86 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "definitions.h"
+
+// many copies of one rom stepped together, for rl rollouts. all state is struct of
+// arrays with the lane index innermost, so "v3 of every lane" is one contiguous run of
+// bytes. while every lane sits at the same pc the instruction is decoded once and its
+// handler is a plain loop over the lanes, which the compiler turns into sse/avx2 code.
+// when the pcs disagree the lanes fall back to smaller runs of neighbours that agree, down
+// to one lane at a time, through the same handlers.
+//
+// only the base instruction set (vip and chip48 quirks) runs here: lores 64x32, 4k of
+// ram, no audio
+class Chip8Batch {
+public:
+    static constexpr size_t MEMORY_SIZE = 4096;
+    static constexpr size_t WIDTH = Chip8::DISPLAY_WIDTH;
+    static constexpr size_t HEIGHT = Chip8::DISPLAY_HEIGHT;
+
+    // every lane starts as a copy of `prototype`, which should already have the rom,
+    // fonts and pre-translation loaded. throws std::invalid_argument for schip/xo-chip
+    Chip8Batch(const Chip8& prototype, size_t lanes, uint64_t seed = 1);
+
+    size_t lanes;
+
+    std::array<std::vector<uint8_t>, Chip8::REGS> v;
+    std::vector<uint16_t> i_reg;
+    std::vector<uint16_t> pc;
+    std::vector<uint8_t> sp;
+    std::vector<uint8_t> dt;
+    std::vector<uint8_t> st;
+    // stack[depth * lanes + lane]
+    std::vector<uint16_t> stack;
+    // bit k is key k held down
+    std::vector<uint16_t> keypad;
+    // FX0A: key being waited on to be released, 0xFF when not waiting
+    std::vector<uint8_t> waitingKey;
+    // ram[lane * MEMORY_SIZE + addr]
+    std::vector<uint8_t> ram;
+    // framebuffer[lane * HEIGHT + y], bit 63 is x = 0 like Display rows
+    std::vector<uint64_t> framebuffer;
+    // lane wrote over pre-translated code, it can't share instruction fetches any more
+    std::vector<uint8_t> codeDirty;
+    // CXNN, xorshift per lane so rollouts are reproducible
+    std::vector<uint64_t> rng;
+
+    // `count` instructions on every lane
+    void runCycles(int count) { (this->*runFn)(count); }
+    void tickTimers();
+    // put one lane back to the prototype state
+    void reset(size_t lane);
+    void seed(size_t lane, uint64_t value);
+
+    bool pixel(size_t lane, size_t x, size_t y) const {
+        return (framebuffer[lane * HEIGHT + y] >> (63 - x)) & 1;
+    }
+
+    uint64_t lockstepSteps = 0;
+    uint64_t divergedSteps = 0;
+
+    // --bench-batch: steps per second of the batch against the same number of Chip8s
+    static void benchmark(const Chip8& prototype, size_t lanes, int frames);
+
+private:
+    // prototype state for reset()
+    std::array<uint8_t, Chip8::REGS> initV;
+    std::array<uint8_t, MEMORY_SIZE> initRam;
+    std::array<uint16_t, Chip8::STACK_SIZE> initStack;
+    uint16_t initI, initPc;
+    uint8_t initSp, initDt, initSt;
+    // addresses the analysis found code at, writes there mark the lane dirty
+    std::vector<uint8_t> codeMap;
+
+    template <typename Q> void run(int count);
+    template <typename Q> void execute(OpKind kind, uint16_t op, size_t begin, size_t end);
+    template <typename Q> void draw(uint16_t op, size_t lane);
+    void writeRam(size_t lane, uint16_t addr, uint8_t val);
+    void (Chip8Batch::*runFn)(int) = nullptr;
+};
+
+#endif // BATCH_H
@@ -0,0 +1,95 @@
+#ifndef BLEND_H
+#define BLEND_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "display.h"
+
+// flicker reduction (--blend). a game that erases a sprite and draws it again a few
+// instructions later shows it in some frames and not in others, depending on where the
+// frame happened to end. the core keeps the last `depth` frames as packed rows and the
+// gui presents a combination of them instead of the live display:
+//   OR        a pixel lit in any of them is lit, plane by plane
+//   WEIGHTED  lit in the newest frame is white, lit only in the one before is light gray,
+//             lit only in older ones dark gray. the planes are looked at together, so
+//             xo-chip colors come out as shades
+// either way it's a few word ops per row once per emulated frame
+class FrameBlend {
+public:
+    enum class Mode { OFF, OR, WEIGHTED };
+    static constexpr size_t MAX_DEPTH = 4;
+
+    Mode mode = Mode::OFF;
+    size_t depth = 2;
+    // what the gui shows while blending, dirtyRows works as on the real display
+    Display output;
+
+    // "or" or "weighted", optionally ":K" frames (2-4)
+    static bool parse(const std::string& spec, Mode& mode, size_t& depth) {
+        size_t colon = spec.find(':');
+        std::string name = spec.substr(0, colon);
+        if (name == "or") {
+            mode = Mode::OR;
+            depth = 2;
+        } else if (name == "weighted") {
+            mode = Mode::WEIGHTED;
+            depth = 3;
+        } else {
+            return false;
+        }
+        if (colon != std::string::npos) {
+            std::string count = spec.substr(colon + 1);
+            if (count.size() != 1 || count[0] < '2' || count[0] > '0' + (int)MAX_DEPTH) return false;
+            depth = count[0] - '0';
+        }
+        return true;
+    }
+
+    // takes the display as it is at the end of a frame, true when the output changed
+    bool push(const Display& display) {
+        // a resolution switch clears the output, that's a change even if the frame is blank
+        bool changed = false;
+        if (output.hires != display.hires) {
+            output.setHires(display.hires);
+            history = {};
+            changed = true;
+        }
+        newest = (newest + 1) % MAX_DEPTH;
+        for (size_t p = 0; p < Display::PLANES; p++) {
+            for (size_t y = 0; y < display.height; y++) history[newest][p][y] = display.row(y, p);
+        }
+
+        for (size_t y = 0; y < display.height; y++) {
+            if (mode == Mode::OR) {
+                for (size_t p = 0; p < Display::PLANES; p++) {
+                    Display::Row any = 0;
+                    for (size_t k = 0; k < depth; k++) any |= frame(k)[p][y];
+                    changed |= output.setRow(y, p, any);
+                }
+            } else {
+                Display::Row now = lit(0, y);
+                Display::Row previous = lit(1, y);
+                Display::Row older = 0;
+                for (size_t k = 2; k < depth; k++) older |= lit(k, y);
+                // palette index 1 white, 2 light gray, 3 dark gray
+                changed |= output.setRow(y, 0, now | (older & ~previous));
+                changed |= output.setRow(y, 1, ~now & (previous | older));
+            }
+        }
+        return changed;
+    }
+
+private:
+    using Frame = std::array<std::array<Display::Row, Display::MAX_HEIGHT>, Display::PLANES>;
+
+    std::array<Frame, MAX_DEPTH> history{};
+    size_t newest = 0;
+
+    // k frames back from the newest
+    const Frame& frame(size_t k) const { return history[(newest + MAX_DEPTH - k) % MAX_DEPTH]; }
+    Display::Row lit(size_t k, size_t y) const { return frame(k)[0][y] | frame(k)[1][y]; }
+};
+
+#endif // BLEND_H
@@ -0,0 +1,335 @@
+#include "capture.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+uint8_t red(int index) { return Display::PALETTE[index] >> 24; }
+uint8_t green(int index) { return Display::PALETTE[index] >> 16; }
+uint8_t blue(int index) { return Display::PALETTE[index] >> 8; }
+
+std::string extensionOf(const std::string& filename) {
+    auto dot = filename.find_last_of('.');
+    return dot == std::string::npos ? "" : filename.substr(dot + 1);
+}
+
+// raw yuv 4:4:4, 60 fps. ffmpeg/mpv read it as is
+class Y4mEncoder : public FrameRecorder::Encoder {
+public:
+    explicit Y4mEncoder(const std::string& filename) : file(filename, std::ios::binary) {
+        if (!file) throw std::runtime_error("Failed to open " + filename);
+        for (int i = 0; i < 4; i++) {
+            // bt.601 studio range
+            double r = red(i), g = green(i), b = blue(i);
+            yuv[i][0] = (uint8_t)(16 + (65.738 * r + 129.057 * g + 25.064 * b) / 256);
+            yuv[i][1] = (uint8_t)(128 + (-37.945 * r - 74.494 * g + 112.439 * b) / 256);
+            yuv[i][2] = (uint8_t)(128 + (112.439 * r - 94.154 * g - 18.285 * b) / 256);
+        }
+    }
+
+    void write(const uint8_t* pixels, size_t width, size_t height) override {
+        if (!headerWritten) {
+            file << "YUV4MPEG2 W" << width << " H" << height << " F60:1 Ip A1:1 C444\n";
+            headerWritten = true;
+        }
+        file << "FRAME\n";
+        plane.resize(width * height);
+        for (int channel = 0; channel < 3; channel++) {
+            for (size_t i = 0; i < plane.size(); i++) plane[i] = yuv[pixels[i]][channel];
+            file.write((const char*)plane.data(), plane.size());
+        }
+    }
+
+private:
+    std::ofstream file;
+    bool headerWritten = false;
+    uint8_t yuv[4][3];
+    std::vector<uint8_t> plane;
+};
+
+// crc32 for png chunks
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void putBE32(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(v >> 24);
+    out.push_back(v >> 16);
+    out.push_back(v >> 8);
+    out.push_back(v);
+}
+
+// one png per frame, 8 bit indexed. the image data goes into stored (uncompressed) deflate
+// blocks, which keeps this free of zlib and fast enough for the encoder thread
+class PngEncoder : public FrameRecorder::Encoder {
+public:
+    explicit PngEncoder(const std::string& filename) {
+        auto dot = filename.find_last_of('.');
+        base = filename.substr(0, dot);
+    }
+
+    void write(const uint8_t* pixels, size_t width, size_t height) override {
+        char name[32];
+        snprintf(name, sizeof(name), "_%06llu.png", (unsigned long long)frame++);
+        std::ofstream file(base + name, std::ios::binary);
+        if (!file) return;
+
+        static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        file.write((const char*)signature, 8);
+
+        std::vector<uint8_t> ihdr;
+        putBE32(ihdr, width);
+        putBE32(ihdr, height);
+        ihdr.insert(ihdr.end(), {8, 3, 0, 0, 0});   // 8 bit, palette, no interlace
+        chunk(file, "IHDR", ihdr);
+
+        std::vector<uint8_t> plte;
+        for (int i = 0; i < 4; i++) plte.insert(plte.end(), {red(i), green(i), blue(i)});
+        chunk(file, "PLTE", plte);
+
+        // scanlines with filter type 0
+        raw.clear();
+        for (size_t y = 0; y < height; y++) {
+            raw.push_back(0);
+            raw.insert(raw.end(), pixels + y * width, pixels + (y + 1) * width);
+        }
+
+        std::vector<uint8_t> idat = {0x78, 0x01};
+        for (size_t pos = 0; pos < raw.size() || pos == 0;) {
+            size_t length = std::min<size_t>(raw.size() - pos, 65535);
+            bool last = pos + length == raw.size();
+            idat.insert(idat.end(), {(uint8_t)last, (uint8_t)length, (uint8_t)(length >> 8),
+                                     (uint8_t)~length, (uint8_t)(~length >> 8)});
+            idat.insert(idat.end(), raw.begin() + pos, raw.begin() + pos + length);
+            pos += length;
+            if (last) break;
+        }
+        uint32_t a = 1, b = 0;
+        for (uint8_t byte : raw) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        putBE32(idat, (b << 16) | a);
+        chunk(file, "IDAT", idat);
+        chunk(file, "IEND", {});
+    }
+
+private:
+    std::string base;
+    uint64_t frame = 0;
+    std::vector<uint8_t> raw;
+
+    void chunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> out;
+        putBE32(out, data.size());
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        putBE32(out, crc32(out.data() + 4, out.size() - 4));
+        file.write((const char*)out.data(), out.size());
+    }
+};
+
+// animated gif with the 4 color palette, lzw compressed, looping forever
+class GifEncoder : public FrameRecorder::Encoder {
+public:
+    explicit GifEncoder(const std::string& filename) : file(filename, std::ios::binary) {
+        if (!file) throw std::runtime_error("Failed to open " + filename);
+    }
+
+    ~GifEncoder() override {
+        if (headerWritten) file.put(0x3B);
+    }
+
+    void write(const uint8_t* pixels, size_t width, size_t height) override {
+        if (!headerWritten) writeHeader(width, height);
+
+        // gif delays are in 1/100 s, spread the 60 fps rounding over the frames
+        uint16_t delay = (uint16_t)((frame + 1) * 100 / 60 - frame * 100 / 60);
+        frame++;
+        const uint8_t gce[] = {0x21, 0xF9, 0x04, 0x00, (uint8_t)delay, (uint8_t)(delay >> 8), 0x00, 0x00};
+        file.write((const char*)gce, sizeof(gce));
+
+        const uint8_t descriptor[] = {0x2C, 0, 0, 0, 0, (uint8_t)width, (uint8_t)(width >> 8),
+                                      (uint8_t)height, (uint8_t)(height >> 8), 0x00};
+        file.write((const char*)descriptor, sizeof(descriptor));
+        compress(pixels, width * height);
+    }
+
+private:
+    static constexpr int MIN_CODE_SIZE = 2;
+
+    std::ofstream file;
+    bool headerWritten = false;
+    uint64_t frame = 0;
+
+    // lzw state. dictionary[code][pixel] is the code for that string plus pixel, 0 if none
+    std::vector<std::array<uint16_t, 4>> dictionary = std::vector<std::array<uint16_t, 4>>(4096);
+    std::vector<uint8_t> block;
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+
+    void writeHeader(size_t width, size_t height) {
+        file.write("GIF89a", 6);
+        // global color table of 4 entries
+        const uint8_t screen[] = {(uint8_t)width, (uint8_t)(width >> 8), (uint8_t)height, (uint8_t)(height >> 8),
+                                  0x91, 0x00, 0x00};
+        file.write((const char*)screen, sizeof(screen));
+        for (int i = 0; i < 4; i++) {
+            const uint8_t rgb[] = {red(i), green(i), blue(i)};
+            file.write((const char*)rgb, 3);
+        }
+        const uint8_t loop[] = {0x21, 0xFF, 0x0B, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0',
+                                0x03, 0x01, 0x00, 0x00, 0x00};
+        file.write((const char*)loop, sizeof(loop));
+        headerWritten = true;
+    }
+
+    void emit(uint32_t code, int size) {
+        bitBuffer |= code << bitCount;
+        bitCount += size;
+        while (bitCount >= 8) {
+            block.push_back(bitBuffer & 0xFF);
+            bitBuffer >>= 8;
+            bitCount -= 8;
+        }
+    }
+
+    void compress(const uint8_t* pixels, size_t count) {
+        const uint16_t clearCode = 1 << MIN_CODE_SIZE;
+        const uint16_t endCode = clearCode + 1;
+        int codeSize = MIN_CODE_SIZE + 1;
+        uint16_t maxCode = endCode;
+
+        block.clear();
+        bitBuffer = 0;
+        bitCount = 0;
+        std::fill(dictionary.begin(), dictionary.end(), std::array<uint16_t, 4>{});
+
+        emit(clearCode, codeSize);
+        int current = -1;
+        for (size_t i = 0; i < count; i++) {
+            uint8_t pixel = pixels[i] & 3;
+            if (current < 0) {
+                current = pixel;
+            } else if (dictionary[current][pixel]) {
+                current = dictionary[current][pixel];
+            } else {
+                emit(current, codeSize);
+                dictionary[current][pixel] = ++maxCode;
+                if (maxCode >= (1 << codeSize)) codeSize++;
+                if (maxCode == 4095) {
+                    emit(clearCode, codeSize);
+                    std::fill(dictionary.begin(), dictionary.end(), std::array<uint16_t, 4>{});
+                    codeSize = MIN_CODE_SIZE + 1;
+                    maxCode = endCode;
+                }
+                current = pixel;
+            }
+        }
+        emit(current, codeSize);
+        emit(clearCode, codeSize);
+        emit(endCode, MIN_CODE_SIZE + 1);
+        if (bitCount > 0) block.push_back(bitBuffer & 0xFF);
+
+        file.put(MIN_CODE_SIZE);
+        for (size_t pos = 0; pos < block.size(); pos += 255) {
+            size_t length = std::min<size_t>(block.size() - pos, 255);
+            file.put((char)length);
+            file.write((const char*)block.data() + pos, length);
+        }
+        file.put(0);
+    }
+};
+
+} // namespace
+
+FrameRecorder::FrameRecorder(const std::string& filename, int scale)
+        : queue(std::make_unique<SpscRing<Frame, QUEUE_FRAMES>>()), scale(scale < 1 ? 1 : scale) {
+    std::string ext = extensionOf(filename);
+    if (ext == "y4m") encoder = std::make_unique<Y4mEncoder>(filename);
+    else if (ext == "gif") encoder = std::make_unique<GifEncoder>(filename);
+    else if (ext == "png") encoder = std::make_unique<PngEncoder>(filename);
+    else throw std::runtime_error("Unknown capture format ." + ext + " (use .y4m, .gif or .png)");
+
+    worker = std::thread(&FrameRecorder::encodeLoop, this);
+}
+
+FrameRecorder::~FrameRecorder() {
+    // finish whatever is queued, then let the encoder close its file
+    stopping = true;
+    worker.join();
+}
+
+bool FrameRecorder::submit(const Display& display) {
+    pending.width = display.width;
+    pending.height = display.height;
+    for (size_t y = 0; y < display.height; y++) {
+        for (size_t x = 0; x < display.width; x++) pending.pixels[y * display.width + x] = display.color(x, y);
+    }
+    return push();
+}
+
+bool FrameRecorder::submit(const uint64_t* rows, size_t width, size_t height) {
+    pending.width = width;
+    pending.height = height;
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) pending.pixels[y * width + x] = (rows[y] >> (63 - x)) & 1;
+    }
+    return push();
+}
+
+bool FrameRecorder::push() {
+    submitted++;
+    if (!queue->push(pending)) {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+void FrameRecorder::encodeLoop() {
+    // the output size is fixed by the first frame. a later resolution switch (schip
+    // lores <-> hires) gets nearest neighbour resampled onto the same canvas
+    size_t canvasWidth = 0, canvasHeight = 0;
+    std::vector<uint8_t> canvas;
+
+    while (true) {
+        const Frame* frame = queue->peek();
+        if (!frame) {
+            if (stopping) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        if (canvas.empty()) {
+            canvasWidth = frame->width * scale;
+            canvasHeight = frame->height * scale;
+            canvas.resize(canvasWidth * canvasHeight);
+        }
+        for (size_t y = 0; y < canvasHeight; y++) {
+            size_t srcY = y * frame->height / canvasHeight;
+            for (size_t x = 0; x < canvasWidth; x++) {
+                canvas[y * canvasWidth + x] = frame->pixels[srcY * frame->width + x * frame->width / canvasWidth];
+            }
+        }
+        queue->pop();
+
+        encoder->write(canvas.data(), canvasWidth, canvasHeight);
+        written++;
+    }
+    encoder.reset();
+}
@@ -0,0 +1,62 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "display.h"
+#include "spsc_ring.h"
+
+// records frames to a y4m video, an animated gif or a numbered png sequence, picked by
+// the file extension. the emulation thread only copies the frame into a ring, a
+// background thread does the encoding. when the encoder falls behind frames are dropped
+// (and counted) instead of stalling the emulator
+class FrameRecorder {
+public:
+    // one frame as palette indices, whatever resolution the core was in
+    struct Frame {
+        uint16_t width;
+        uint16_t height;
+        std::array<uint8_t, Display::MAX_WIDTH * Display::MAX_HEIGHT> pixels;
+    };
+
+    class Encoder {
+    public:
+        virtual ~Encoder() = default;
+        // `pixels` is the scaled canvas, width * height palette indices
+        virtual void write(const uint8_t* pixels, size_t width, size_t height) = 0;
+    };
+
+    // throws std::runtime_error if the extension is unknown or the file can't be opened
+    FrameRecorder(const std::string& filename, int scale);
+    ~FrameRecorder();
+
+    // false when the ring is full and the frame was dropped
+    bool submit(const Display& display);
+    // 1 bit rows with the leftmost pixel in bit 63, like Chip8Batch::framebuffer
+    bool submit(const uint64_t* rows, size_t width, size_t height);
+
+    uint64_t submitted = 0;
+    uint64_t dropped = 0;
+    std::atomic<uint64_t> written{0};
+
+private:
+    static constexpr size_t QUEUE_FRAMES = 32;
+
+    std::unique_ptr<SpscRing<Frame, QUEUE_FRAMES>> queue;
+    std::unique_ptr<Encoder> encoder;
+    int scale;
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+    // staging frame, filled then pushed so submit() doesn't put 8k on the stack
+    Frame pending;
+
+    bool push();
+    void encodeLoop();
+};
+
+#endif // CAPTURE_H
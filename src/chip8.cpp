@@ -6,70 +6,171 @@
 #include <chrono>
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 #include "definitions.h"
 #include "gui.h"
 #include "sound.h"
+#include "batch.h"
+#include "capture.h"
+#include "profiler.h"
+#include "perf.h"
+#include "pacer.h"
+#include "debugger.h"
+#include "gdbstub.h"
+#include "tiles.h"
 
 #include "../include/tinyfiledialogs.h"
 
 std::atomic<bool> running(true);
 
 // chip8 functions
-void read_file(const std::string filename, std::array<uint8_t, Chip8::MEMORY_SIZE>& ram) {
+// returns how many bytes were loaded, 0 if the rom couldn't be read
+size_t read_file(const std::string filename, std::array<uint8_t, Chip8::MEMORY_SIZE>& ram) {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
     if (!file) {
         std::cerr << "Error: Failed to open file " << filename << std::endl;
-        return;
+        return 0;
     }
 
     std::streamsize size = file.tellg();
     file.seekg(0, std::ios::beg);
     if (size > Chip8::MEMORY_SIZE - 0x200) {
         std::cerr << "Error: ROM too large to fit in memory!" << std::endl;
-        return;
+        return 0;
     }
     file.read(reinterpret_cast<char*>(&ram[0x200]), size);
     file.close();
+    return size;
 }
 
-uint16_t fetch(std::array<uint8_t, Chip8::MEMORY_SIZE>& ram, uint16_t& pc) {
-    uint8_t high_byte = ram[pc];
-    uint8_t low_byte = ram[pc + 1];
-    uint16_t op = (high_byte << 8) | low_byte;
 
-    pc += 0x2;
-    return op;
+// waits for the encoder to drain the queue and close the file
+void finishRecording(std::unique_ptr<FrameRecorder>& recorder) {
+    if (!recorder) return;
+    uint64_t dropped = recorder->dropped;
+    uint64_t submitted = recorder->submitted;
+    recorder.reset();
+    std::cout << "Recorded " << submitted - dropped << " frames (" << dropped << " dropped)" << std::endl;
 }
 
-void cycle(std::array<uint8_t, Chip8::MEMORY_SIZE>& ram, uint16_t& pc, Chip8& chip8) {
-    uint16_t op = fetch(ram, pc);
-    chip8.exec(op);
-}
-
-
-void timerLoop(Chip8& chip8, Sound &sound) {
-    using namespace std::chrono;
-    auto nextCycle = high_resolution_clock::now();
-    while (running) {
-        nextCycle += milliseconds(16);
-
-        if (chip8.dt > 0) chip8.dt--;
-        if (chip8.st > 0) {
-            chip8.st--;
-            sound.play(chip8.st > 0);
-        }
 
-        std::this_thread::sleep_until(nextCycle);
-    }
+// --grid with several roms: every rom after the first is set up like main() sets up the
+// first one, with the same clock, stack policy and blending. nullptr if it can't be read
+static std::unique_ptr<Chip8> loadMachine(const std::string& filename, const std::string& quirksName, const Chip8& settings) {
+    auto machine = std::make_unique<Chip8>();
+    QuirkProfile profile = quirksName.empty() ? detectQuirkProfile(filename) : settings.quirks;
+    machine->setQuirks(profile);
+    machine->clock = settings.clock;
+    machine->blend.mode = settings.blend.mode;
+    machine->blend.depth = settings.blend.depth;
+    machine->setStackPolicy(settings.stackPolicy);
+    machine->v_reg.fill(0);
+    if (read_file(filename, machine->ram) == 0) return nullptr;
+    machine->loadFonts(*machine, machine->ram);
+    machine->translate(analyzeRom(machine->ram, 0x200, profile));
+    machine->opcode_00E0();
+    return machine;
 }
 
-
 int main(int argc, char** argv) {
 
     std::string filename;
+    std::string quirksName;
+    std::string wavName;
+    bool headless = false;
+    int frames = 600;
+    uint32_t sampleRate = SAMPLE_RATE;
+    size_t benchLanes = 0;
+    std::string recordName;
+    int recordScale = 4;
+    std::string traceName;
+    bool perfCounters = false;
+    std::vector<std::string> breakSpecs;
+    std::vector<std::string> watchSpecs;
+    std::string gdbWhere;
+    std::string stackName;
+    std::string keymapName;
+    std::string filterName;
+    bool phosphor = false;
+    std::string blendName;
+    size_t gridCount = 0;
+    std::vector<std::string> romNames;
+    ClockModel clock = ClockModel::instructionsPerFrame(Chip8::INSTRUCTIONS_PER_FRAME);
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--quirks" && i + 1 < argc) {
+            quirksName = argv[++i];
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::stoi(argv[++i]);
+        } else if (arg == "--wav" && i + 1 < argc) {
+            wavName = argv[++i];
+        } else if (arg == "--sample-rate" && i + 1 < argc) {
+            sampleRate = std::stoul(argv[++i]);
+        } else if (arg == "--ips" && i + 1 < argc) {
+            clock = ClockModel::instructionsPerSecond(std::stoul(argv[++i]));
+        } else if (arg == "--ipf" && i + 1 < argc) {
+            clock = ClockModel::instructionsPerFrame(std::stoul(argv[++i]));
+        } else if (arg == "--clock" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode != "vip") {
+                std::cerr << "Unknown clock " << mode << " (use vip, or --ips/--ipf for a fixed rate)\n";
+                return 1;
+            }
+            clock = ClockModel::vip();
+        } else if (arg == "--break" && i + 1 < argc) {
+            breakSpecs.push_back(argv[++i]);
+        } else if (arg == "--watch" && i + 1 < argc) {
+            watchSpecs.push_back(argv[++i]);
+        } else if (arg == "--gdb" && i + 1 < argc) {
+            gdbWhere = argv[++i];
+            headless = true;
+        } else if (arg == "--stack" && i + 1 < argc) {
+            stackName = argv[++i];
+        } else if (arg == "--keymap" && i + 1 < argc) {
+            keymapName = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filterName = argv[++i];
+        } else if (arg == "--blend" && i + 1 < argc) {
+            blendName = argv[++i];
+        } else if (arg == "--grid" && i + 1 < argc) {
+            gridCount = std::stoul(argv[++i]);
+        } else if (arg == "--phosphor") {
+            phosphor = true;
+        } else if (arg == "--perf") {
+            perfCounters = true;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceName = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordName = argv[++i];
+        } else if (arg == "--record-scale" && i + 1 < argc) {
+            recordScale = std::stoi(argv[++i]);
+        } else if (arg == "--bench-batch" && i + 1 < argc) {
+            benchLanes = std::stoul(argv[++i]);
+            headless = true;
+        } else if (arg == "--bench-audio") {
+            Sound::benchmark();
+            return 0;
+        } else {
+            filename = arg;
+            romNames.push_back(arg);
+        }
+    }
 
-    if (argc < 2) {
+    if (filename.empty() && headless) {
+        std::cerr << "--headless/--gdb need a rom file\n";
+        return 1;
+    }
+    // grid machines run without a debugger, a breakpoint would never fire
+    if (gridCount > 0 && (!breakSpecs.empty() || !watchSpecs.empty())) {
+        std::cerr << "--break/--watch don't work with --grid\n";
+        return 1;
+    }
+    if (filename.empty()) {
         const char* filters[] = {"*.ch8", "*.rom"};
         filename = tinyfd_openFileDialog("Select CHIP-8 ROM", "", 2, filters, "CHIP-8 ROM Files", 0);
 
@@ -79,26 +180,187 @@ int main(int argc, char** argv) {
             std::cerr << "No file selected. Exiting.\n";
             return 1;
         }
-    } else {
-        filename = argv[1];
     }
 
     Chip8 chip8;
-    Sound sound;
 
-    std::thread timerThread(timerLoop, std::ref(chip8), std::ref(sound));
+    QuirkProfile profile = detectQuirkProfile(filename);
+    if (!quirksName.empty()) {
+        auto parsed = parseQuirkProfile(quirksName);
+        if (!parsed) {
+            std::cerr << "Unknown quirk profile " << quirksName << " (use vip, chip48, schip or xochip)\n";
+            return 1;
+        }
+        profile = *parsed;
+    }
+    chip8.setQuirks(profile);
+    std::cout << "Quirks: " << quirkProfileName(profile) << std::endl;
+    if (clock.cyclesPerSecond == 0) {
+        std::cerr << "--ips/--ipf must be at least 1\n";
+        return 1;
+    }
+    chip8.clock = clock;
+    if (clock.mode == ClockMode::VIP) std::cout << "Clock: COSMAC VIP instruction timing" << std::endl;
+    else std::cout << "Clock: " << clock.cyclesPerSecond << " instructions per second" << std::endl;
+    // the sound device clocks itself off emulated cycles, the core feeds it events.
+    // --wav renders to a file instead, no device needed
+    std::unique_ptr<AudioSink> sound;
+    if (!wavName.empty()) {
+        sound = std::make_unique<WavSink>(wavName, chip8.clock.cyclesPerSecond, sampleRate);
+    } else if (!headless) {
+        sound = std::make_unique<Sound>(chip8.clock.cyclesPerSecond);
+    }
+    if (sound) chip8.audioOut = sound->events();
+
+    // --record: every emulated frame goes to a y4m/gif/png sequence, encoded off thread
+    std::unique_ptr<FrameRecorder> recorder;
+    if (!recordName.empty()) {
+        recorder = std::make_unique<FrameRecorder>(recordName, recordScale);
+    }
 
     for (size_t i = 0; i < chip8.v_reg.size(); i++) {
         chip8.v_reg[i] = 0x0;
     }
 
-    if (!initSDL()) {
+    if (!headless && !initSDL()) {
+        return 1;
+    }
+    if (!filterName.empty() && !Scaler::parseFilter(filterName, scaler.filter)) {
+        std::cerr << "Unknown filter " << filterName << " (use none, scanlines or grid)\n";
+        return 1;
+    }
+    scaler.phosphor = phosphor;
+    if (!blendName.empty() && !FrameBlend::parse(blendName, chip8.blend.mode, chip8.blend.depth)) {
+        std::cerr << "Unknown blend " << blendName << " (use or or weighted, with an optional :2-4 frames)\n";
+        return 1;
+    }
+    if (!headless && !keymapName.empty() && !keyMap.load(keymapName)) {
+        return 1;
+    }
+    if (read_file(filename, chip8.ram) == 0 && headless) {
         return 1;
     }
-    read_file(filename, chip8.ram);
 
     chip8.loadFonts(chip8, chip8.ram);
 
+    // find the code up front so the interpreter doesn't have to decode it every cycle
+    RomAnalysis analysis = analyzeRom(chip8.ram, 0x200, profile);
+    chip8.translate(analysis);
+    std::cout << "Pre-translated " << analysis.blocks.size() << " blocks (" << analysis.codeBytes << " bytes of code)" << std::endl;
+
+    if (benchLanes > 0) {
+        Chip8Batch::benchmark(chip8, benchLanes, frames);
+        return 0;
+    }
+
+    // clear screen cause some roms dont do that for some reason
+    chip8.opcode_00E0();
+
+    Profiler profiler;
+    if (!traceName.empty()) profiler.startTrace();
+
+    PerfCounters perf;
+    if (perfCounters && perf.open()) chip8.setPerfCounters(&perf);
+
+    // always attached, it costs nothing until something is set
+    Debugger debugger(chip8);
+    if (stackName == "halt") {
+        chip8.setStackPolicy(Chip8::StackPolicy::HALT);
+    } else if (stackName == "trap") {
+        chip8.setStackPolicy(Chip8::StackPolicy::TRAP);
+    } else if (!stackName.empty() && stackName != "wrap") {
+        std::cerr << "Unknown stack policy " << stackName << " (use wrap, halt or trap)\n";
+        return 1;
+    }
+    for (const std::string& spec : breakSpecs) {
+        if (!debugger.parseBreakpoint(spec)) {
+            std::cerr << "Bad breakpoint " << spec << " (use ADDR or ADDR:vX=NN, in hex)\n";
+            return 1;
+        }
+    }
+    for (const std::string& spec : watchSpecs) {
+        if (!debugger.parseWatchpoint(spec)) {
+            std::cerr << "Bad watchpoint " << spec << " (use ADDR[+LEN][:r|w|rw], in hex)\n";
+            return 1;
+        }
+    }
+
+    // --gdb: the client drives the machine, no window
+    if (!gdbWhere.empty()) {
+        GdbStub stub(chip8, debugger);
+        if (!stub.listen(gdbWhere)) return 1;
+        stub.serve();
+        finishRecording(recorder);
+        return 0;
+    }
+
+    // no window, no pacing: run a fixed number of frames as fast as possible
+    if (headless) {
+        int frame = 0;
+        for (; frame < frames; frame++) {
+            Profiler::Scope zone(profiler, ZONE_EMULATE);
+            chip8.runFrame();
+            if (debugger.stopped != Debugger::Stop::NONE) {
+                debugger.printStop();
+                break;
+            }
+            if (chip8.halted) break;
+            chip8.tickTimers();
+            if (sound) sound->flush(chip8.cycles);
+            if (recorder) recorder->submit(chip8.presented());
+        }
+        std::cout << "Ran " << frame << " frames (" << chip8.cycles << " cycles)" << std::endl;
+        chip8.printFusionReport();
+        profiler.printReport();
+        perf.printReport();
+        if (!traceName.empty()) profiler.writeTrace(traceName);
+        finishRecording(recorder);
+        return 0;
+    }
+
+    // --grid: N machines side by side, the roms on the command line take turns. window
+    // events still go through the main machine, which doesn't run itself
+    if (gridCount > 0) {
+        if (romNames.empty()) romNames.push_back(filename);
+        chip8.setDebugger(nullptr);
+        std::vector<std::unique_ptr<Chip8>> prototypes;
+        for (size_t i = 1; i < romNames.size(); i++) {
+            auto prototype = loadMachine(romNames[i], quirksName, chip8);
+            if (!prototype) return 1;
+            prototypes.push_back(std::move(prototype));
+        }
+        std::vector<std::unique_ptr<Chip8>> machines;
+        for (size_t i = 0; i < gridCount; i++) {
+            size_t rom = i % romNames.size();
+            auto machine = std::make_unique<Chip8>(rom == 0 ? chip8 : *prototypes[rom - 1]);
+            machine->audioOut = nullptr;
+            machine->perf = nullptr;
+            machine->setQuirks(machine->quirks);
+            machines.push_back(std::move(machine));
+        }
+
+        TileGrid grid(std::move(machines));
+        std::cout << "Grid: " << gridCount << " machines in " << grid.columns << "x" << grid.rows << " tiles" << std::endl;
+        FramePacer pacer(Chip8::FRAMES_PER_SECOND);
+        while (running.load()) {
+            int due = pacer.framesDue();
+            for (int frame = 0; frame < due; frame++) {
+                handleInput(running, chip8);
+                uint16_t keys = keypadInput.snapshot();
+                if (!running || paused) break;
+                grid.runFrame(keys);
+            }
+            if (!running) break;
+            if (renderTiles(grid, chip8.displayChanged)) chip8.displayChanged = false;
+            pacer.wait();
+        }
+        cleanupSDL();
+        grid.printReport();
+        pacer.printReport();
+        presentPolicy.printReport();
+        return 0;
+    }
+
     for (size_t i = 0; i < chip8.ram.size(); i++) {
         if (i == 0x200) {
             printf("\n0x200: %02X ", chip8.ram[i]);
@@ -108,36 +370,66 @@ int main(int argc, char** argv) {
     }
     std::cout << std::endl;
 
-    // clear screen cause some roms dont do that for some reason
-    chip8.opcode_00E0();
-
+    FramePacer pacer(Chip8::FRAMES_PER_SECOND);
     while (running.load()) {
-        auto frameStart = std::chrono::high_resolution_clock::now();
+        profiler.begin(ZONE_FRAME);
 
-        handleInput(running, chip8);
+        // normally 1, more when the last iteration ran long. input is sampled right before
+        // each emulated frame, so catch-up frames see keys pressed in between too
+        int due = pacer.framesDue();
+        for (int frame = 0; frame < due; frame++) {
+            profiler.begin(ZONE_INPUT);
+            handleInput(running, chip8);
+            chip8.keypad = keypadInput.snapshot();
+            profiler.end(ZONE_INPUT);
+            if (!running || paused) break;
 
-        if (!running) break;
-        if (!paused) {
-            for (int i = 0; i < Chip8::INSTRUCTIONS_PER_FRAME; i++) {
-                cycle(chip8.ram, chip8.pc, chip8);
+            Profiler::Scope zone(profiler, ZONE_EMULATE);
+            chip8.runFrame();
+            if (debugger.stopped != Debugger::Stop::NONE) {
+                // hand control to the keyboard, SPACE carries on, F10/F11 step
+                debugger.printStop();
+                debugger.stopped = Debugger::Stop::NONE;
+                paused = true;
+                chip8.displayChanged = true;
+                break;
             }
+            chip8.tickTimers();
+            if (sound) sound->flush(chip8.cycles);
+            if (recorder) recorder->submit(chip8.presented());
         }
-        if (chip8.displayChanged) {
-            render(chip8);
-            chip8.displayChanged = false;
+        if (!running) break;
+        if (chip8.displayChanged || showOverlay || scaler.fading()) {
+            Profiler::Scope zone(profiler, ZONE_RENDER);
+            bool changed = chip8.displayChanged;
+            // a held back or hidden frame stays pending and goes out with a later one
+            if (render(chip8, showOverlay ? &profiler : nullptr) && changed) {
+                inputLatency.presented(chip8.frameCount);
+            }
         }
         if (chip8.debugUpdateCounter % 30 == 0) {
+            Profiler::Scope zone(profiler, ZONE_DEBUG_INFO);
             renderDebugInfo(chip8);
         }
         chip8.debugUpdateCounter++;
+        profiler.begin(ZONE_DEBUG_WINDOW);
         renderDebugWindow();
-        auto frameTime = std::chrono::high_resolution_clock::now() - frameStart;
-        auto remainingTime = std::chrono::milliseconds(Chip8::FRAME_DURATION_MS) - frameTime;
-        if (remainingTime.count() > 0) {
-            std::this_thread::sleep_for(remainingTime);
-        }
+        profiler.end(ZONE_DEBUG_WINDOW);
+
+        profiler.begin(ZONE_SLEEP);
+        pacer.wait();
+        profiler.end(ZONE_SLEEP);
+        profiler.end(ZONE_FRAME);
     }
     cleanupSDL();
+    chip8.printFusionReport();
+    profiler.printReport();
+    pacer.printReport();
+    inputLatency.printReport();
+    presentPolicy.printReport();
+    perf.printReport();
+    if (!traceName.empty()) profiler.writeTrace(traceName);
+    finishRecording(recorder);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <cstdint>
+#include "decode.h"
+
+// how emulated time is counted. INSTRUCTIONS charges one cycle per instruction, so
+// cyclesPerSecond is the ips. VIP charges every instruction its time on the cosmac vip
+// interpreter in microseconds, and DXYN waits for the next vblank like the original does
+enum class ClockMode {
+    INSTRUCTIONS,
+    VIP
+};
+
+struct ClockModel {
+    static constexpr int FRAMES_PER_SECOND = 60;
+    static constexpr uint64_t VIP_CYCLES_PER_SECOND = 1000000;
+
+    ClockMode mode = ClockMode::INSTRUCTIONS;
+    uint64_t cyclesPerSecond = 600;
+
+    static ClockModel instructionsPerSecond(uint64_t ips) { return {ClockMode::INSTRUCTIONS, ips}; }
+    static ClockModel instructionsPerFrame(uint64_t ipf) { return {ClockMode::INSTRUCTIONS, ipf * FRAMES_PER_SECOND}; }
+    static ClockModel vip() { return {ClockMode::VIP, VIP_CYCLES_PER_SECOND}; }
+
+    // budget for frame n. taken as the difference of two absolute positions so rates that
+    // don't divide by 60 still add up to exactly cyclesPerSecond every second
+    uint64_t frameCycles(uint64_t frame) const {
+        return (frame + 1) * cyclesPerSecond / FRAMES_PER_SECOND - frame * cyclesPerSecond / FRAMES_PER_SECOND;
+    }
+};
+
+// average microseconds per instruction on the vip interpreter. skips are the mean of taken
+// and not taken, FX55/FX65 grow with the register count. DXYN is only the setup, the rest of
+// its time is the vblank wait which the scheduler handles. instructions the vip never had
+// are charged like a plain register op
+inline int vipCycles(OpKind kind, uint16_t op) {
+    switch (kind) {
+        case OP_00E0: return 109;
+        case OP_00EE: return 105;
+        case OP_1NNN: return 105;
+        case OP_2NNN: return 105;
+        case OP_3XNN: return 55;
+        case OP_4XNN: return 55;
+        case OP_5XY0: return 73;
+        case OP_6XNN: return 27;
+        case OP_7XNN: return 45;
+        case OP_8XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3: case OP_8XY4:
+        case OP_8XY5: case OP_8XY6: case OP_8XY7: case OP_8XYE: return 200;
+        case OP_9XY0: return 73;
+        case OP_ANNN: return 55;
+        case OP_BNNN: return 105;
+        case OP_CXNN: return 164;
+        case OP_DXYN: return 68;
+        case OP_EX9E: return 73;
+        case OP_EXA1: return 73;
+        case OP_FX07: return 45;
+        case OP_FX0A: return 45;
+        case OP_FX15: return 45;
+        case OP_FX18: return 45;
+        case OP_FX1E: return 86;
+        case OP_FX29: return 91;
+        case OP_FX33: return 927;
+        case OP_FX55:
+        case OP_FX65: return 64 + 36 * ((op >> 8) & 0xF);
+        case OP_NOP: return 45;
+        default: return 45;
+    }
+}
+
+#endif // CLOCK_H
@@ -0,0 +1,265 @@
+#include "debugger.h"
+#include "definitions.h"
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+Debugger::Debugger(Chip8& chip8) : chip8(chip8), flags(Chip8::MEMORY_SIZE, 0) {
+    chip8.setDebugger(this);
+}
+
+Debugger::~Debugger() {
+    if (chip8.debugger == this) chip8.setDebugger(nullptr);
+}
+
+void Debugger::addBreakpoint(uint16_t addr) {
+    setFlag(addr, BREAK);
+    refresh();
+}
+
+void Debugger::addBreakpoint(uint16_t addr, uint8_t reg, uint8_t value) {
+    conditions.push_back({addr, (uint8_t)(reg & 0xF), value});
+    setFlag(addr, BREAK_IF);
+    refresh();
+}
+
+void Debugger::removeBreakpoint(uint16_t addr) {
+    clearFlag(addr, BREAK | BREAK_IF);
+    std::erase_if(conditions, [&](const Condition& c) { return c.addr == addr; });
+    refresh();
+}
+
+void Debugger::addWatchpoint(uint16_t addr, uint16_t length, uint8_t watch) {
+    watch &= WATCH_READ | WATCH_WRITE;
+    for (uint32_t i = 0; i < length; i++) setFlag(addr + i, watch);
+    refresh();
+}
+
+void Debugger::removeWatchpoint(uint16_t addr, uint16_t length, uint8_t watch) {
+    watch &= WATCH_READ | WATCH_WRITE;
+    for (uint32_t i = 0; i < length; i++) clearFlag(addr + i, watch);
+    refresh();
+}
+
+void Debugger::clear() {
+    std::fill(flags.begin(), flags.end(), 0);
+    breakpointCount = 0;
+    watchCount = 0;
+    conditions.clear();
+    stepMode = STEP_NONE;
+    refresh();
+}
+
+void Debugger::step() {
+    stepMode = STEP_NONE;
+    resumeAt = -1;
+    chip8.stepInstruction();
+    stop(Stop::STEP);
+    refresh();
+}
+
+void Debugger::stepOver() {
+    uint16_t op = (chip8.ram[chip8.pc] << 8) | chip8.ram[(uint16_t)(chip8.pc + 1)];
+    if ((op & 0xF000) != 0x2000) {
+        step();
+        return;
+    }
+    // stop once we're back at the instruction after the call on the same stack level
+    stepMode = STEP_OVER;
+    stepPc = chip8.pc + 2;
+    stepSp = chip8.sp;
+    refresh();
+}
+
+void Debugger::stepOut() {
+    stepMode = STEP_OUT;
+    stepSp = chip8.sp;
+    refresh();
+}
+
+bool Debugger::active() const {
+    return breakpointCount || watchCount || stepMode != STEP_NONE
+           || chip8.stackPolicy == Chip8::StackPolicy::TRAP;
+}
+
+bool Debugger::check(OpKind kind, uint16_t op) {
+    uint16_t pc = chip8.pc;
+    if (resumeAt == pc) {
+        // carrying on from the last stop, let this one instruction run
+        resumeAt = -1;
+        return false;
+    }
+    resumeAt = -1;
+
+    if (stepMode == STEP_OVER && pc == stepPc && chip8.sp <= stepSp) {
+        stop(Stop::STEP);
+        return true;
+    }
+    if (stepMode == STEP_OUT && chip8.sp < stepSp) {
+        stop(Stop::STEP);
+        return true;
+    }
+    if (chip8.stackPolicy == Chip8::StackPolicy::TRAP
+        && ((kind == OP_2NNN && chip8.sp >= Chip8::STACK_SIZE) || (kind == OP_00EE && chip8.sp == 0))) {
+        stop(Stop::STACK_FAULT);
+        return true;
+    }
+    if ((flags[pc] & (BREAK | BREAK_IF)) && hitBreakpoint(pc)) {
+        stop(Stop::BREAKPOINT);
+        return true;
+    }
+    return watchCount && hitWatch(kind, op);
+}
+
+bool Debugger::hitBreakpoint(uint16_t addr) const {
+    if (flags[addr] & BREAK) return true;
+    for (const Condition& c : conditions) {
+        if (c.addr == addr && chip8.v_reg[c.reg] == c.value) return true;
+    }
+    return false;
+}
+
+// the ram range the instruction is about to touch, through I. the fetch itself and the
+// stack (which isn't in ram here) don't count
+bool Debugger::hitWatch(OpKind kind, uint16_t op) {
+    uint8_t x = (op >> 8) & 0xF;
+    uint8_t y = (op >> 4) & 0xF;
+    uint32_t length = 0;
+    uint8_t access = WATCH_READ;
+    switch (kind) {
+        case OP_DXYN: {
+            QuirkInfo info = quirkInfo(chip8.quirks);
+            uint32_t n = op & 0xF;
+            length = n ? n : (info.superChip ? 32 : 0);
+            if (info.xoChip) length *= std::popcount((unsigned)(chip8.display.selected & 0x3));
+            break;
+        }
+        case OP_FX33: length = 3; access = WATCH_WRITE; break;
+        case OP_FX55: length = x + 1; access = WATCH_WRITE; break;
+        case OP_FX65: length = x + 1; break;
+        case OP_F002: length = 16; break;
+        case OP_5XY2: length = std::abs(x - y) + 1; access = WATCH_WRITE; break;
+        case OP_5XY3: length = std::abs(x - y) + 1; break;
+        default: return false;
+    }
+    uint16_t mask = quirkInfo(chip8.quirks).memoryMask;
+    for (uint32_t i = 0; i < length; i++) {
+        uint16_t addr = (chip8.i_reg + i) & mask;
+        if (flags[addr] & access) {
+            watchAddr = addr;
+            stop(access == WATCH_WRITE ? Stop::WATCH_WRITE : Stop::WATCH_READ);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Debugger::stop(Stop reason) {
+    stopped = reason;
+    stopAddr = chip8.pc;
+    resumeAt = chip8.pc;
+    if (reason == Stop::STEP && stepMode != STEP_NONE) {
+        stepMode = STEP_NONE;
+        refresh();
+    }
+}
+
+// the counts follow every flag byte as it changes, so adding or removing one never has
+// to look at the other 64k
+void Debugger::setFlag(uint16_t addr, uint8_t bits) {
+    updateFlag(addr, flags[addr] | bits);
+}
+
+void Debugger::clearFlag(uint16_t addr, uint8_t bits) {
+    updateFlag(addr, flags[addr] & ~bits);
+}
+
+void Debugger::updateFlag(uint16_t addr, uint8_t value) {
+    uint8_t old = flags[addr];
+    bool wasBreak = old & (BREAK | BREAK_IF);
+    bool wasWatch = old & (WATCH_READ | WATCH_WRITE);
+    bool isBreak = value & (BREAK | BREAK_IF);
+    bool isWatch = value & (WATCH_READ | WATCH_WRITE);
+    breakpointCount += isBreak - wasBreak;
+    watchCount += isWatch - wasWatch;
+    flags[addr] = value;
+}
+
+void Debugger::refresh() {
+    // swaps the interpreter when we go active/inactive
+    chip8.setDebugger(this);
+}
+
+// "2A4" or "2A4:v3=10", hex everywhere
+bool Debugger::parseBreakpoint(const std::string& spec) {
+    char* end = nullptr;
+    unsigned long addr = strtoul(spec.c_str(), &end, 16);
+    if (end == spec.c_str() || addr >= Chip8::MEMORY_SIZE) return false;
+    if (*end == '\0') {
+        addBreakpoint((uint16_t)addr);
+        return true;
+    }
+
+    if (end[0] != ':' || (end[1] != 'v' && end[1] != 'V')) return false;
+    const char* cond = end + 2;
+    unsigned long reg = strtoul(cond, &end, 16);
+    if (end == cond || reg >= Chip8::REGS || *end != '=') return false;
+    cond = end + 1;
+    unsigned long value = strtoul(cond, &end, 16);
+    if (end == cond || *end != '\0' || value > 0xFF) return false;
+    addBreakpoint((uint16_t)addr, (uint8_t)reg, (uint8_t)value);
+    return true;
+}
+
+// "300", "300+16" or "300+16:r" / ":w" / ":rw", hex, default 1 byte read+write
+bool Debugger::parseWatchpoint(const std::string& spec) {
+    char* end = nullptr;
+    unsigned long addr = strtoul(spec.c_str(), &end, 16);
+    if (end == spec.c_str() || addr >= Chip8::MEMORY_SIZE) return false;
+
+    unsigned long length = 1;
+    if (*end == '+') {
+        const char* len = end + 1;
+        length = strtoul(len, &end, 16);
+        if (end == len || length == 0 || length > Chip8::MEMORY_SIZE) return false;
+    }
+
+    uint8_t watch = WATCH_READ | WATCH_WRITE;
+    if (*end == ':') {
+        std::string mode = end + 1;
+        if (mode == "r") watch = WATCH_READ;
+        else if (mode == "w") watch = WATCH_WRITE;
+        else if (mode != "rw") return false;
+    } else if (*end != '\0') {
+        return false;
+    }
+    addWatchpoint((uint16_t)addr, (uint16_t)std::min<unsigned long>(length, 0xFFFF), watch);
+    return true;
+}
+
+const char* Debugger::stopName(Stop stop) {
+    switch (stop) {
+        case Stop::NONE: return "running";
+        case Stop::BREAKPOINT: return "breakpoint";
+        case Stop::WATCH_READ: return "read watchpoint";
+        case Stop::WATCH_WRITE: return "write watchpoint";
+        case Stop::STEP: return "step";
+        case Stop::STACK_FAULT: return "stack overflow/underflow";
+    }
+    return "?";
+}
+
+void Debugger::printStop() const {
+    std::cout << std::hex << std::uppercase << std::setfill('0')
+              << "Stopped at 0x" << std::setw(3) << stopAddr << " (" << stopName(stopped);
+    if (stopped == Stop::WATCH_READ || stopped == Stop::WATCH_WRITE) {
+        std::cout << " on 0x" << std::setw(3) << watchAddr;
+    }
+    std::cout << ")  I=" << std::setw(3) << chip8.i_reg;
+    for (size_t i = 0; i < Chip8::REGS; i++) {
+        std::cout << " V" << i << "=" << std::setw(2) << (int)chip8.v_reg[i];
+    }
+    std::cout << std::dec << std::nouppercase << std::setfill(' ') << std::endl;
+}
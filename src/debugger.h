@@ -0,0 +1,111 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "decode.h"
+
+class Chip8;
+
+// pc breakpoints (optionally only when a register holds a value), ram read/write
+// watchpoints and stepping. every address has one flag byte, and the core only switches
+// to its checking instantiation (Chip8::runDebug) while something is set or a step is
+// armed, so the normal interpreter never looks at any of this.
+// the core stops *before* the instruction that hit, with pc still pointing at it.
+// running again carries on from there without stopping on the same spot twice
+class Debugger {
+public:
+    enum Flag : uint8_t {
+        BREAK = 1,
+        WATCH_READ = 2,
+        WATCH_WRITE = 4,
+        BREAK_IF = 8        // has conditional breakpoints, see conditions
+    };
+
+    enum class Stop {
+        NONE,
+        BREAKPOINT,
+        WATCH_READ,
+        WATCH_WRITE,
+        STEP,
+        STACK_FAULT     // Chip8::StackPolicy::TRAP
+    };
+
+    explicit Debugger(Chip8& chip8);
+    ~Debugger();
+    Debugger(const Debugger&) = delete;
+    Debugger& operator=(const Debugger&) = delete;
+
+    void addBreakpoint(uint16_t addr);
+    // only stops when v[reg] == value
+    void addBreakpoint(uint16_t addr, uint8_t reg, uint8_t value);
+    void removeBreakpoint(uint16_t addr);
+    void addWatchpoint(uint16_t addr, uint16_t length, uint8_t flags);
+    void removeWatchpoint(uint16_t addr, uint16_t length, uint8_t flags = WATCH_READ | WATCH_WRITE);
+    void clear();
+
+    // runs one instruction right away
+    void step();
+    // over a 2NNN call, or just one instruction for anything else. like stepOut this only
+    // arms the stop, the next run() goes until it's reached (or something else hits)
+    void stepOver();
+    // until the current subroutine has returned
+    void stepOut();
+
+    // which of WATCH_READ/WATCH_WRITE are set on addr
+    uint8_t watchFlags(uint16_t addr) const { return flags[addr] & (WATCH_READ | WATCH_WRITE); }
+
+    // breakpoints, watchpoints, a step armed or the stack trap on, the core has to check
+    bool active() const;
+
+    // called by the debug core for every instruction before it runs
+    bool check(OpKind kind, uint16_t op);
+
+    // why and where the core last stopped. whoever drives the core clears it
+    Stop stopped = Stop::NONE;
+    uint16_t stopAddr = 0;
+    // the watched byte that was about to be accessed
+    uint16_t watchAddr = 0;
+
+    // "--break 2A4", "--break 2A4:v3=10", "--watch 300+16:rw". false on bad syntax
+    bool parseBreakpoint(const std::string& spec);
+    bool parseWatchpoint(const std::string& spec);
+    static const char* stopName(Stop stop);
+    // where and why we stopped, plus the registers
+    void printStop() const;
+
+private:
+    struct Condition {
+        uint16_t addr;
+        uint8_t reg;
+        uint8_t value;
+    };
+
+    enum StepMode { STEP_NONE, STEP_OVER, STEP_OUT };
+
+    Chip8& chip8;
+    std::vector<uint8_t> flags;
+    std::vector<Condition> conditions;
+    size_t breakpointCount = 0;
+    size_t watchCount = 0;
+
+    StepMode stepMode = STEP_NONE;
+    uint16_t stepPc = 0;
+    uint16_t stepSp = 0;
+    // the instruction we stopped on last, let through once when resuming
+    int resumeAt = -1;
+
+    bool hitBreakpoint(uint16_t addr) const;
+    bool hitWatch(OpKind kind, uint16_t op);
+    void stop(Stop reason);
+    // every flag byte change goes through these, they keep the counts up to date
+    void setFlag(uint16_t addr, uint8_t bits);
+    void clearFlag(uint16_t addr, uint8_t bits);
+    void updateFlag(uint16_t addr, uint8_t value);
+    // tells the core to swap interpreters when active() changes
+    void refresh();
+};
+
+#endif // DEBUGGER_H
@@ -0,0 +1,122 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <cstdint>
+
+// every instruction the interpreter knows, so decoding can happen once (at load time for
+// pre-translated code, or per fetch otherwise) and execution is a single flat switch
+enum OpKind : uint8_t {
+    OP_NONE = 0,    // not decoded yet, only ever stored in the translation table
+    OP_NOP,         // 0NNN machine code calls and other holes the original ignored
+    OP_UNKNOWN,
+    OP_00E0, OP_00EE, OP_00CN, OP_00DN, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF,
+    OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_5XY2, OP_5XY3, OP_6XNN, OP_7XNN,
+    OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+    OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN, OP_EX9E, OP_EXA1,
+    OP_F000, OP_FN01, OP_F002, OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29,
+    OP_FX30, OP_FX33, OP_FX3A, OP_FX55, OP_FX65, OP_FX75, OP_FX85,
+    // superinstructions, only ever written to the translation table by Chip8::translate.
+    // each one runs a common sequence of plain handlers back to back in one dispatch
+    OP_ANNN_DXYN,         // point at a sprite and draw it
+    OP_6XNN_6XNN,         // load two registers, usually sprite coordinates
+    OP_7XNN_3XNN,         // bump a loop counter and test it
+    OP_FX07_3XNN_1NNN,    // spin until the delay timer runs out
+    OP_COUNT
+};
+
+constexpr OpKind OP_FUSED_FIRST = OP_ANNN_DXYN;
+
+// how many plain instructions a superinstruction stands for
+inline int fusedLength(OpKind kind) {
+    return kind == OP_FX07_3XNN_1NNN ? 3 : 2;
+}
+
+inline OpKind decode(uint16_t op, bool superChip, bool xoChip) {
+    uint8_t d4 = op & 0x000F;
+    switch (op >> 12) {
+        case 0x0:
+            if (op == 0x00E0) return OP_00E0;
+            if (op == 0x00EE) return OP_00EE;
+            if (superChip) {
+                if ((op & 0xFFF0) == 0x00C0) return OP_00CN;
+                if (op == 0x00FB) return OP_00FB;
+                if (op == 0x00FC) return OP_00FC;
+                if (op == 0x00FD) return OP_00FD;
+                if (op == 0x00FE) return OP_00FE;
+                if (op == 0x00FF) return OP_00FF;
+            }
+            if (xoChip && (op & 0xFFF0) == 0x00D0) return OP_00DN;
+            return OP_NOP;
+        case 0x1: return OP_1NNN;
+        case 0x2: return OP_2NNN;
+        case 0x3: return OP_3XNN;
+        case 0x4: return OP_4XNN;
+        case 0x5:
+            if (d4 == 0) return OP_5XY0;
+            if (xoChip && d4 == 2) return OP_5XY2;
+            if (xoChip && d4 == 3) return OP_5XY3;
+            return OP_NOP;
+        case 0x6: return OP_6XNN;
+        case 0x7: return OP_7XNN;
+        case 0x8:
+            switch (d4) {
+                case 0x0: return OP_8XY0;
+                case 0x1: return OP_8XY1;
+                case 0x2: return OP_8XY2;
+                case 0x3: return OP_8XY3;
+                case 0x4: return OP_8XY4;
+                case 0x5: return OP_8XY5;
+                case 0x6: return OP_8XY6;
+                case 0x7: return OP_8XY7;
+                case 0xE: return OP_8XYE;
+                default: return OP_NOP;
+            }
+        case 0x9: return OP_9XY0;
+        case 0xA: return OP_ANNN;
+        case 0xB: return OP_BNNN;
+        case 0xC: return OP_CXNN;
+        case 0xD: return OP_DXYN;
+        case 0xE:
+            if ((op & 0x00FF) == 0x9E) return OP_EX9E;
+            if ((op & 0x00FF) == 0xA1) return OP_EXA1;
+            return OP_NOP;
+        case 0xF:
+            if (xoChip && op == 0xF000) return OP_F000;
+            if (xoChip && op == 0xF002) return OP_F002;
+            switch (op & 0x00FF) {
+                case 0x01: return xoChip ? OP_FN01 : OP_UNKNOWN;
+                case 0x07: return OP_FX07;
+                case 0x0A: return OP_FX0A;
+                case 0x15: return OP_FX15;
+                case 0x18: return OP_FX18;
+                case 0x1E: return OP_FX1E;
+                case 0x29: return OP_FX29;
+                case 0x30: return superChip ? OP_FX30 : OP_UNKNOWN;
+                case 0x33: return OP_FX33;
+                case 0x3A: return xoChip ? OP_FX3A : OP_UNKNOWN;
+                case 0x55: return OP_FX55;
+                case 0x65: return OP_FX65;
+                case 0x75: return superChip ? OP_FX75 : OP_UNKNOWN;
+                case 0x85: return superChip ? OP_FX85 : OP_UNKNOWN;
+                default: return OP_UNKNOWN;
+            }
+    }
+    return OP_UNKNOWN;
+}
+
+// opcode pattern names, indexed by OpKind
+inline const char* opKindName(OpKind kind) {
+    static const char* names[OP_COUNT] = {
+        "----", "0NNN", "????",
+        "00E0", "00EE", "00CN", "00DN", "00FB", "00FC", "00FD", "00FE", "00FF",
+        "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "5XY2", "5XY3", "6XNN", "7XNN",
+        "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+        "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1",
+        "F000", "FN01", "F002", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29",
+        "FX30", "FX33", "FX3A", "FX55", "FX65", "FX75", "FX85",
+        "ANNN+DXYN", "6XNN+6XNN", "7XNN+3XNN", "FX07+3XNN+1NNN",
+    };
+    return kind < OP_COUNT ? names[kind] : "????";
+}
+
+#endif // DECODE_H
@@ -5,42 +5,55 @@
 #include <vector>
 #include <string>
 #include <array>
-#include <SDL2/SDL_rect.h>
+#include "quirks.h"
+#include "display.h"
+#include "decode.h"
+#include "analyzer.h"
+#include "audio_events.h"
+#include "clock.h"
+#include "blend.h"
+
+class PerfCounters;
+class Debugger;
 
 class Chip8 {
 public:
     Chip8();
 
-    static constexpr size_t MEMORY_SIZE = 4096;
+    // xo-chip address space, plain chip8/schip roms only ever see the first 4k
+    static constexpr size_t MEMORY_SIZE = 65536;
     static constexpr size_t DISPLAY_WIDTH = 64;
     static constexpr size_t DISPLAY_HEIGHT = 32;
+    static constexpr size_t HIRES_WIDTH = 128;
+    static constexpr size_t HIRES_HEIGHT = 64;
     static constexpr size_t REGS = 16;
     static constexpr size_t KEYS = 16;
     static constexpr size_t STACK_SIZE = 16;
+    static constexpr size_t FLAG_REGS = 16;
+    // the default speed, --ips/--ipf/--clock vip pick another clock per rom
     static constexpr int INSTRUCTIONS_PER_FRAME = 10;
-    static constexpr int FRAME_DURATION_MS = 1000 / 60;
+    static constexpr int FRAMES_PER_SECOND = ClockModel::FRAMES_PER_SECOND;
 
     int debugUpdateCounter = 0;
-    mutable std::vector<SDL_Rect> dirtyRects;
     mutable bool displayChanged = false;
 
-    std::array<bool, DISPLAY_WIDTH * DISPLAY_HEIGHT> display;
+    Display display;
+    // --blend, the last few frames combined to hide sprite flicker
+    FrameBlend blend;
+    // what a frontend should show: the display, or the blended frames when that's on
+    const Display& presented() const { return blend.mode == FrameBlend::Mode::OFF ? display : blend.output; }
 
     void setPixel(int x, int y, bool value) {
-        if (x < 0 || x >= DISPLAY_WIDTH || y < 0 || y >= DISPLAY_HEIGHT) return;
+        if (x < 0 || x >= (int)display.width || y < 0 || y >= (int)display.height) return;
 
-        int index = y * DISPLAY_WIDTH + x;
-        if (display[index] != value) {
-            display[index] = value;
-            dirtyRects.push_back({x, y, 1, 1});
+        if (display.get(x, y) != value) {
+            display.set(x, y, value);
             displayChanged = true;
         }
     }
 
     void clearScreen() {
-        display.fill(false);
-        dirtyRects.clear();
-        dirtyRects.push_back({0, 0, Chip8::DISPLAY_WIDTH, Chip8::DISPLAY_HEIGHT});
+        display.clear();
         displayChanged = true;
     }
 
@@ -52,11 +65,100 @@ public:
     bool waitingForKey = false;
     uint8_t waitingKey;
     std::array<uint8_t, REGS> v_reg;
-    std::array<bool, KEYS> keypad;
+    // bit n = key n held. the host writes a fresh snapshot before every frame
+    uint16_t keypad = 0;
     std::array<uint16_t, STACK_SIZE> stack;
+    // schip FX75/FX85 "rpl" user flags
+    std::array<uint8_t, FLAG_REGS> flags{};
+    // xo-chip audio, F002 loads a 128 bit 1-bit sample loop and FX3A sets its playback pitch
+    std::array<uint8_t, 16> audioPattern{};
+    uint8_t pitch = 64;
+
+    // emulated time in clock cycles (clock.cyclesPerSecond of them per second). audio
+    // events are stamped with it
+    uint64_t cycles = 0;
+    ClockModel clock = ClockModel::instructionsPerFrame(INSTRUCTIONS_PER_FRAME);
+    // frames run so far and what's left of the current frame's budget. an instruction that
+    // overdraws the budget borrows from the next frame
+    uint64_t frameCount = 0;
+    int64_t cycleBudget = 0;
+
+    // one 60hz frame worth of emulation, the timers are still up to the caller
+    void runFrame() {
+        if (halted) return;
+        // a redraw the gui still owes (held back frame, window exposed, debugger stop)
+        bool pending = displayChanged;
+        cycleBudget += clock.frameCycles(frameCount++);
+        if (clock.mode == ClockMode::VIP) {
+            (this->*timedFn)();
+        } else {
+            runCycles((int)cycleBudget);
+            cycleBudget = 0;
+        }
+        if (stackFault) stackFaulted();
+        // while blending, only a change of the blended image counts on top of what was
+        // already pending. the draws themselves set displayChanged every frame a sprite
+        // flickers
+        if (blend.mode != FrameBlend::Mode::OFF) displayChanged = blend.push(display) || pending;
+    }
+
+    // a rom calling deeper than STACK_SIZE or returning from an empty stack. the stack
+    // index is always masked so it just wraps around, the policy says what else happens:
+    // WRAP carries on, HALT stops the machine at the end of the frame, TRAP stops in the
+    // debugger right before the offending 2NNN/00EE (and halts when there's no debugger)
+    enum class StackPolicy { WRAP, HALT, TRAP };
+    StackPolicy stackPolicy = StackPolicy::WRAP;
+    void setStackPolicy(StackPolicy policy) {
+        stackPolicy = policy;
+        setQuirks(quirks);
+    }
+    // set by push/pop without branching, looked at once per frame
+    bool stackFault = false;
+    uint64_t stackFaults = 0;
+    bool halted = false;
+    void stackFaulted();
+    // buzzer on/off edges and xo-chip audio changes go here when a sound device listens
+    AudioEventQueue* audioOut = nullptr;
+    uint64_t audioEventsDropped = 0;
+    bool buzzer = false;
+
+    // 60hz delay/sound timer tick, called once per frame by whoever drives the core
+    void tickTimers() {
+        if (dt > 0) dt--;
+        if (st > 0 && --st == 0) setBuzzer(false);
+    }
+
+    void setBuzzer(bool on) {
+        if (on == buzzer) return;
+        buzzer = on;
+        emitAudio(on ? AudioEvent::GATE_ON : AudioEvent::GATE_OFF);
+    }
+
+    void emitAudio(AudioEvent::Type type) {
+        if (!audioOut) return;
+        if (!audioOut->push({cycles, type, pitch, audioPattern})) audioEventsDropped++;
+    }
+
+    // quirk profile, picks which specialized interpreter runs the rom
+    QuirkProfile quirks = QuirkProfile::VIP;
+    void setQuirks(QuirkProfile profile);
+
+    template <typename Q> void exec(uint16_t op);
+    template <typename Q> void dispatch(OpKind kind, uint16_t op);
+    template <typename Q> int dispatchFused(OpKind kind, uint16_t op);
+    // PROFILE reads the hardware counters around every dispatch (--perf)
+    template <typename Q, bool PROFILE> void run(int count);
+    // spends cycleBudget at vip instruction costs, DXYN ends the frame
+    template <typename Q, bool DEBUG> void runTimed();
+    // run() without fusion, asking the debugger before every instruction
+    template <typename Q> void runDebug(int count);
+    template <typename Q> void stepOne();
+    void exec(uint16_t op) { (this->*execFn)(op); }
+    void runCycles(int count) { (this->*runFn)(count); }
+    // exactly one instruction, no breakpoints
+    void stepInstruction() { (this->*stepFn)(); }
 
     void read_file(const std::string filename, std::array<uint8_t, Chip8::MEMORY_SIZE>& ram);
-    void exec(uint16_t op);
     uint16_t fetch(std::array<uint8_t, Chip8::MEMORY_SIZE>& ram, uint16_t& pc);
     void cycle(uint16_t op);
     void loadFonts(Chip8& chip8, std::array<uint8_t, Chip8::MEMORY_SIZE>& ram);
@@ -66,10 +168,54 @@ public:
     uint16_t pop();
 
     std::vector<uint8_t> rom;
-    std::array<uint8_t, 4096> ram{};
+    std::array<uint8_t, MEMORY_SIZE> ram{};
+
+    // instructions decoded ahead of time from the static analysis, OP_NONE everywhere else.
+    // common sequences get fused into superinstructions. any ram write drops the entries
+    // it overlaps (a fused triple reaches back 5 bytes) so self-modifying code still works
+    std::vector<OpKind> translated = std::vector<OpKind>(MEMORY_SIZE, OP_NONE);
+    void translate(const RomAnalysis& analysis);
+
+    void writeRam(uint16_t addr, uint8_t val) {
+        ram[addr] = val;
+        for (uint16_t back = 0; back < 6; back++) {
+            translated[(uint16_t)(addr - back)] = OP_NONE;
+        }
+    }
+
+    // every ram access of the core goes through these. addresses wrap at the profile's
+    // address space (Q::memoryMask) instead of being checked, so a wild I or pc costs nothing
+    template <typename Q> uint8_t load(uint32_t addr) const { return ram[addr & Q::memoryMask]; }
+    template <typename Q> uint16_t loadWord(uint32_t addr) const { return load<Q>(addr) << 8 | load<Q>(addr + 1); }
+    template <typename Q> void store(uint32_t addr, uint8_t val) { writeRam(addr & Q::memoryMask, val); }
+
+    // how often each superinstruction ran, indexed from OP_FUSED_FIRST
+    std::array<uint64_t, OP_COUNT - OP_FUSED_FIRST> fusionCounts{};
+    // cycles skipped by fast-forwarding delay timer spin loops
+    uint64_t spinCyclesSkipped = 0;
+    void printFusionReport() const;
+
+    // --perf, swaps in run<Q, true>. nullptr goes back to the normal core
+    PerfCounters* perf = nullptr;
+    void setPerfCounters(PerfCounters* counters) {
+        perf = counters;
+        setQuirks(quirks);
+    }
+
+    // breakpoints/watchpoints. the debug core only runs while the debugger has something
+    // set, it calls this again whenever that changes. a hit stops the core mid-frame
+    Debugger* debugger = nullptr;
+    void setDebugger(Debugger* dbg) {
+        debugger = dbg;
+        setQuirks(quirks);
+    }
 
     // fonts yay!!!
     std::array<uint8_t, 80> font{};
+    // schip 8x10 font for FX30, loaded right after the small one
+    std::array<uint8_t, 160> bigFont{};
+    static constexpr uint16_t FONT_ADDR = 0x50;
+    static constexpr uint16_t BIG_FONT_ADDR = 0xA0;
 
     // opcodes
     void opcode_00E0();
@@ -77,26 +223,43 @@ public:
     void opcode_6XNN(uint16_t& op);
     void opcode_7XNN(uint16_t& op);
     void opcode_ANNN(uint16_t& op);
-    void opcode_BNNN(uint16_t& op);
-    void opcode_3XNN(uint16_t& op);
-    void opcode_4XNN(uint16_t& op);
-    void opcode_5XY0(uint16_t& op);
-    void opcode_9XY0(uint16_t& op);
+    template <typename Q> void opcode_BNNN(uint16_t& op);
+    template <typename Q> void opcode_3XNN(uint16_t& op);
+    template <typename Q> void opcode_4XNN(uint16_t& op);
+    template <typename Q> void opcode_5XY0(uint16_t& op);
+    template <typename Q> void opcode_9XY0(uint16_t& op);
     void opcode_00EE();
+    template <typename Q> void skip();
     void opcode_2NNN(uint16_t& op);
     // arithmetic operations
     void opcode_8XY0(uint16_t& op);
-    void opcode_8XY1(uint16_t& op);
-    void opcode_8XY2(uint16_t& op);
-    void opcode_8XY3(uint16_t& op);
+    template <typename Q> void opcode_8XY1(uint16_t& op);
+    template <typename Q> void opcode_8XY2(uint16_t& op);
+    template <typename Q> void opcode_8XY3(uint16_t& op);
     void opcode_8XY4(uint16_t& op);
     void opcode_8XY5(uint16_t& op);
-    void opcode_8XY6(uint16_t& op);
+    template <typename Q> void opcode_8XY6(uint16_t& op);
     void opcode_8XY7(uint16_t& op);
-    void opcode_8XYE(uint16_t& op);
+    template <typename Q> void opcode_8XYE(uint16_t& op);
+    // schip display
+    void opcode_00CN(uint16_t& op);
+    void opcode_00FB();
+    void opcode_00FC();
+    void opcode_00FD();
+    void opcode_00FE();
+    void opcode_00FF();
+    // xo-chip
+    void opcode_00DN(uint16_t& op);
+    template <typename Q> void opcode_5XY2(uint16_t& op);
+    template <typename Q> void opcode_5XY3(uint16_t& op);
+    template <typename Q> void opcode_F000();
+    void opcode_FN01(uint16_t& op);
+    template <typename Q> void opcode_F002();
+    void opcode_FX3A(uint16_t& op);
     // draw
-    void opcode_DXYN(uint16_t& op);
+    template <typename Q> void opcode_DXYN(uint16_t& op);
     void opcode_FX29(uint16_t& op);
+    void opcode_FX30(uint16_t& op);
     void opcode_CXNN(uint16_t& op);
     void opcode_FX07(uint16_t& op);
     // timers
@@ -105,13 +268,22 @@ public:
     void opcode_FX1E(uint16_t& op);
     // keypad
     void opcode_FX0A(uint16_t& op);
-    void opcode_EXA1(uint16_t& op);
-    void opcode_EX9E(uint16_t& op);
+    template <typename Q> void opcode_EXA1(uint16_t& op);
+    template <typename Q> void opcode_EX9E(uint16_t& op);
     // ram stuff
-    void opcode_FX33(uint16_t& op);
-    void opcode_FX55(uint16_t& op);
-    void opcode_FX65(uint16_t& op);
+    template <typename Q> void opcode_FX33(uint16_t& op);
+    template <typename Q> void opcode_FX55(uint16_t& op);
+    template <typename Q> void opcode_FX65(uint16_t& op);
+    void opcode_FX75(uint16_t& op);
+    void opcode_FX85(uint16_t& op);
 
+private:
+    void (Chip8::*execFn)(uint16_t) = nullptr;
+    void (Chip8::*runFn)(int) = nullptr;
+    void (Chip8::*timedFn)() = nullptr;
+    void (Chip8::*stepFn)() = nullptr;
+    // points the fn pointers above at the instantiations for Q
+    template <typename Q> void useCore();
 };
 
 #endif // DEFINITIONS_H
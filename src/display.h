@@ -0,0 +1,158 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+// packed framebuffer: one bit per pixel, one 128 bit word per row, leftmost pixel in the
+// top bit. lores mode only uses the top-left 64x32. each xo-chip bitplane keeps its rows
+// in a ring indexed from its own `base`, so a vertical scroll moves the base instead of
+// copying every row. the gui combines the planes into a 2 bit color index per pixel
+class Display {
+public:
+    using Row = unsigned __int128;
+
+    static constexpr size_t MAX_WIDTH = 128;
+    static constexpr size_t MAX_HEIGHT = 64;
+    static constexpr size_t PLANES = 2;
+    // rgba, indexed by the 2 bit plane combination of each pixel (see color())
+    static constexpr uint32_t PALETTE[4] = {0x000000FF, 0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF};
+
+    size_t width = 64;
+    size_t height = 32;
+    bool hires = false;
+    // xo-chip FN01, bit n selects plane n for drawing, clearing and scrolling
+    uint8_t selected = 0x1;
+    // bit y is set when logical row y changed since the gui last drew it. the gui clears it
+    // through a const Chip8, like displayChanged
+    mutable uint64_t dirtyRows = 0;
+
+    // 00E0, only touches the selected planes
+    void clear() {
+        for (size_t p = 0; p < PLANES; p++) {
+            if (!(selected & (1 << p))) continue;
+            planes[p].rows.fill(0);
+            planes[p].base = 0;
+        }
+        markAllDirty();
+    }
+
+    // 00FE/00FF, switching resolution always starts from a blank screen
+    void setHires(bool enable) {
+        hires = enable;
+        width = enable ? 128 : 64;
+        height = enable ? 64 : 32;
+        for (Plane& plane : planes) {
+            plane.rows.fill(0);
+            plane.base = 0;
+        }
+        markAllDirty();
+    }
+
+    Row row(size_t y, size_t plane = 0) const {
+        return planes[plane].rows[(planes[plane].base + y) & (height - 1)];
+    }
+
+    bool get(size_t x, size_t y) const {
+        return (row(y) >> (MAX_WIDTH - 1 - x)) & 1;
+    }
+
+    // palette index of a pixel, plane n gives bit n
+    uint8_t color(size_t x, size_t y) const {
+        uint8_t index = 0;
+        for (size_t p = 0; p < PLANES; p++) {
+            index |= ((row(y, p) >> (MAX_WIDTH - 1 - x)) & 1) << p;
+        }
+        return index;
+    }
+
+    void set(size_t x, size_t y, bool value) {
+        Row& r = planes[0].rows[(planes[0].base + y) & (height - 1)];
+        Row bit = Row(1) << (MAX_WIDTH - 1 - x);
+        r = value ? (r | bit) : (r & ~bit);
+        dirtyRows |= uint64_t(1) << y;
+    }
+
+    // replaces a whole row of one plane, for images computed from other displays
+    // (FrameBlend). false when it already held that
+    bool setRow(size_t y, size_t plane, Row value) {
+        Row& r = planes[plane].rows[(planes[plane].base + y) & (height - 1)];
+        if (r == value) return false;
+        r = value;
+        dirtyRows |= uint64_t(1) << y;
+        return true;
+    }
+
+    // xors a `bits` wide sprite row (msb first) into one plane at x,y and returns true if
+    // it erased anything. Wrap sends pixels past the right edge around to the left
+    template <bool Wrap>
+    bool drawRow(size_t plane, size_t x, size_t y, uint16_t pattern, size_t bits) {
+        Row sprite = Row(pattern) << (MAX_WIDTH - bits);
+        Row placed = (sprite >> x) & widthMask();
+        if constexpr (Wrap) {
+            if (x + bits > width) placed |= (sprite << (width - x)) & widthMask();
+        }
+        if (!placed) return false;
+
+        Row& r = planes[plane].rows[(planes[plane].base + y) & (height - 1)];
+        bool collision = (r & placed) != 0;
+        r ^= placed;
+        dirtyRows |= uint64_t(1) << y;
+        return collision;
+    }
+
+    // 00CN
+    void scrollDown(size_t n) {
+        n = n < height ? n : height;
+        for (size_t p = 0; p < PLANES; p++) {
+            if (!(selected & (1 << p))) continue;
+            Plane& plane = planes[p];
+            plane.base = (plane.base - n) & (height - 1);
+            for (size_t y = 0; y < n; y++) plane.rows[(plane.base + y) & (height - 1)] = 0;
+        }
+        markAllDirty();
+    }
+
+    // xo-chip 00DN
+    void scrollUp(size_t n) {
+        n = n < height ? n : height;
+        for (size_t p = 0; p < PLANES; p++) {
+            if (!(selected & (1 << p))) continue;
+            Plane& plane = planes[p];
+            for (size_t y = 0; y < n; y++) plane.rows[(plane.base + y) & (height - 1)] = 0;
+            plane.base = (plane.base + n) & (height - 1);
+        }
+        markAllDirty();
+    }
+
+    // 00FB
+    void scrollRight(size_t n) {
+        for (size_t p = 0; p < PLANES; p++) {
+            if (!(selected & (1 << p))) continue;
+            for (size_t y = 0; y < height; y++) planes[p].rows[y] = (planes[p].rows[y] >> n) & widthMask();
+        }
+        markAllDirty();
+    }
+
+    // 00FC
+    void scrollLeft(size_t n) {
+        for (size_t p = 0; p < PLANES; p++) {
+            if (!(selected & (1 << p))) continue;
+            for (size_t y = 0; y < height; y++) planes[p].rows[y] = (planes[p].rows[y] << n) & widthMask();
+        }
+        markAllDirty();
+    }
+
+private:
+    struct Plane {
+        std::array<Row, MAX_HEIGHT> rows{};
+        size_t base = 0;
+    };
+    std::array<Plane, PLANES> planes{};
+
+    Row widthMask() const { return ~Row(0) << (MAX_WIDTH - width); }
+    void markAllDirty() { dirtyRows = height == 64 ? ~uint64_t(0) : (uint64_t(1) << height) - 1; }
+};
+
+#endif // DISPLAY_H
@@ -0,0 +1,152 @@
+#include "env.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+Chip8 makePrototype(std::span<const uint8_t> rom, int quirks) {
+    if (quirks < 0 || quirks > (int)QuirkProfile::XOCHIP) {
+        throw std::invalid_argument("unknown quirk profile");
+    }
+    if (rom.size() > Chip8Batch::MEMORY_SIZE - 0x200) {
+        throw std::invalid_argument("rom too large for the batch engine");
+    }
+    Chip8 chip8;
+    chip8.setQuirks((QuirkProfile)quirks);
+    std::copy(rom.begin(), rom.end(), chip8.ram.begin() + 0x200);
+    chip8.loadFonts(chip8, chip8.ram);
+    chip8.translate(analyzeRom(chip8.ram, 0x200, chip8.quirks));
+    return chip8;
+}
+
+// one byte of packed pixels -> 8 bytes of 0/1, msb first
+struct ByteExpand {
+    uint64_t table[256];
+    ByteExpand() {
+        for (int b = 0; b < 256; b++) {
+            uint8_t bytes[8];
+            for (int i = 0; i < 8; i++) bytes[i] = (b >> (7 - i)) & 1;
+            memcpy(&table[b], bytes, 8);
+        }
+    }
+};
+const ByteExpand expand;
+
+} // namespace
+
+Chip8Env::Chip8Env(std::span<const uint8_t> rom, size_t numEnvs, const chip8_env_config& config)
+        : batch(makePrototype(rom, config.quirks), numEnvs), config(config), lastScore(numEnvs, 0) {
+    if (config.reward_addr >= (int)Chip8Batch::MEMORY_SIZE || config.done_addr >= (int)Chip8Batch::MEMORY_SIZE) {
+        throw std::invalid_argument("reward/done address outside ram");
+    }
+}
+
+size_t Chip8Env::observationSize() const {
+    size_t pixels = Chip8Batch::WIDTH * Chip8Batch::HEIGHT;
+    return config.obs_format == CHIP8_OBS_BYTES ? pixels : pixels / 8;
+}
+
+void Chip8Env::bind(uint8_t* obs, float* rewards, uint8_t* dones) {
+    this->obs = obs;
+    this->rewards = rewards;
+    this->dones = dones;
+}
+
+int Chip8Env::score(size_t index) const {
+    if (config.reward_addr < 0) return 0;
+    const uint8_t* mem = &batch.ram[index * Chip8Batch::MEMORY_SIZE];
+    int value = mem[config.reward_addr];
+    if (config.reward_bytes == 2) value = (value << 8) | mem[(config.reward_addr + 1) & (Chip8Batch::MEMORY_SIZE - 1)];
+    return value;
+}
+
+void Chip8Env::observe(size_t index) {
+    if (!obs) return;
+    uint8_t* out = obs + index * observationSize();
+    const uint64_t* rows = &batch.framebuffer[index * Chip8Batch::HEIGHT];
+
+    for (size_t y = 0; y < Chip8Batch::HEIGHT; y++) {
+        for (int byte = 0; byte < 8; byte++) {
+            uint8_t bits = rows[y] >> (56 - byte * 8);
+            if (config.obs_format == CHIP8_OBS_BYTES) {
+                memcpy(out, &expand.table[bits], 8);
+                out += 8;
+            } else {
+                *out++ = bits;
+            }
+        }
+    }
+}
+
+void Chip8Env::reset(size_t index, uint64_t seed) {
+    batch.reset(index);
+    batch.seed(index, seed);
+    lastScore[index] = score(index);
+    observe(index);
+    if (rewards) rewards[index] = 0.0f;
+    if (dones) dones[index] = 0;
+}
+
+void Chip8Env::step(const uint16_t* actions, int frameskip) {
+    std::copy(actions, actions + numEnvs(), batch.keypad.begin());
+    for (int frame = 0; frame < frameskip; frame++) {
+        batch.runCycles(Chip8::INSTRUCTIONS_PER_FRAME);
+        batch.tickTimers();
+    }
+
+    for (size_t index = 0; index < numEnvs(); index++) {
+        observe(index);
+        int value = score(index);
+        if (rewards) rewards[index] = (float)(config.reward_delta ? value - lastScore[index] : value);
+        lastScore[index] = value;
+        if (dones) {
+            dones[index] = config.done_addr >= 0 && batch.ram[index * Chip8Batch::MEMORY_SIZE + config.done_addr] != 0;
+        }
+    }
+}
+
+// c abi, exceptions stop here
+
+struct chip8_env {
+    Chip8Env env;
+};
+
+chip8_env_config chip8_env_default_config(void) {
+    chip8_env_config config;
+    config.quirks = 0;
+    config.obs_format = CHIP8_OBS_BITS;
+    config.reward_addr = -1;
+    config.reward_bytes = 1;
+    config.reward_delta = 1;
+    config.done_addr = -1;
+    return config;
+}
+
+chip8_env* chip8_env_create(const uint8_t* rom, size_t rom_size, size_t num_envs, const chip8_env_config* config) {
+    chip8_env_config defaults = chip8_env_default_config();
+    try {
+        return new chip8_env{Chip8Env({rom, rom_size}, num_envs, config ? *config : defaults)};
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+}
+
+void chip8_env_destroy(chip8_env* env) {
+    delete env;
+}
+
+size_t chip8_env_obs_size(const chip8_env* env) {
+    return env->env.observationSize();
+}
+
+void chip8_env_bind(chip8_env* env, uint8_t* obs, float* rewards, uint8_t* dones) {
+    env->env.bind(obs, rewards, dones);
+}
+
+void chip8_env_reset(chip8_env* env, size_t index, uint64_t seed) {
+    env->env.reset(index, seed);
+}
+
+void chip8_env_step(chip8_env* env, const uint16_t* actions, int frameskip) {
+    env->env.step(actions, frameskip);
+}
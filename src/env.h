@@ -0,0 +1,81 @@
+#ifndef ENV_H
+#define ENV_H
+
+// gym style environment api on top of the batch engine, for training pipelines.
+// observations, rewards and done flags go straight into buffers the caller owns (a numpy
+// array, a shared memory segment...), step() never allocates. the c functions at the
+// bottom wrap the same thing for ffi
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    CHIP8_OBS_BITS = 0,     // 64x32 packed 1 bit per pixel, msb is the leftmost pixel, 256 bytes
+    CHIP8_OBS_BYTES = 1,    // one byte per pixel (0 or 1), row major, 2048 bytes
+};
+
+typedef struct chip8_env_config {
+    int quirks;          // 0 vip, 1 chip48
+    int obs_format;      // CHIP8_OBS_BITS or CHIP8_OBS_BYTES
+    int reward_addr;     // ram address the score lives at, -1 for no reward
+    int reward_bytes;    // 1 or 2 (big endian)
+    int reward_delta;    // reward is the change since the last step instead of the raw value
+    int done_addr;       // episode is over when this byte is nonzero, -1 to never end
+} chip8_env_config;
+
+typedef struct chip8_env chip8_env;
+
+chip8_env_config chip8_env_default_config(void);
+// NULL if the rom doesn't fit or the quirks aren't supported by the batch engine
+chip8_env* chip8_env_create(const uint8_t* rom, size_t rom_size, size_t num_envs, const chip8_env_config* config);
+void chip8_env_destroy(chip8_env* env);
+// bytes of observation per environment, the obs buffer needs num_envs times this
+size_t chip8_env_obs_size(const chip8_env* env);
+// obs: num_envs * obs_size bytes, rewards/dones: num_envs entries. any may be NULL
+void chip8_env_bind(chip8_env* env, uint8_t* obs, float* rewards, uint8_t* dones);
+void chip8_env_reset(chip8_env* env, size_t index, uint64_t seed);
+// actions[i] is the keypad of env i for this step, bit k = key k held
+void chip8_env_step(chip8_env* env, const uint16_t* actions, int frameskip);
+
+#ifdef __cplusplus
+}
+
+#include <span>
+#include <vector>
+
+#include "batch.h"
+
+class Chip8Env {
+public:
+    // throws std::invalid_argument if the rom is too big or the quirks aren't batchable
+    Chip8Env(std::span<const uint8_t> rom, size_t numEnvs, const chip8_env_config& config);
+
+    size_t numEnvs() const { return batch.lanes; }
+    size_t observationSize() const;
+
+    void bind(uint8_t* obs, float* rewards, uint8_t* dones);
+    void reset(size_t index, uint64_t seed);
+    // runs `frameskip` frames with the same keys held, then fills the bound buffers
+    void step(const uint16_t* actions, int frameskip);
+
+    Chip8Batch batch;
+
+private:
+    chip8_env_config config;
+    uint8_t* obs = nullptr;
+    float* rewards = nullptr;
+    uint8_t* dones = nullptr;
+    // last score per env for reward_delta
+    std::vector<int> lastScore;
+
+    int score(size_t index) const;
+    void observe(size_t index);
+};
+
+#endif // __cplusplus
+
+#endif // ENV_H
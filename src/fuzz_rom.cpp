@@ -0,0 +1,71 @@
+// fuzzing harness (-DCHIP8_FUZZ=ON). the input is a rom with a one byte header: bits 0-1
+// pick the quirk profile, bit 2 the vip clock. the rest goes through the same load path as
+// a real rom (copy to 0x200, static analysis, pre-translation) and then runs for a bounded
+// number of frames, with the keypad driven from the input so the key paths get reached.
+// built with clang this is a libFuzzer target. anything else gets a main() that runs
+// every file named on the command line, or stdin, which is what afl and crash replays need
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "definitions.h"
+
+static constexpr int FUZZ_FRAMES = 64;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size < 1) return 0;
+    static constexpr QuirkProfile PROFILES[] = {
+        QuirkProfile::VIP, QuirkProfile::CHIP48, QuirkProfile::SCHIP, QuirkProfile::XOCHIP
+    };
+    QuirkProfile profile = PROFILES[data[0] & 0x3];
+
+    // 64k of ram plus the translation table, too much for the stack under asan
+    auto chip8 = std::make_unique<Chip8>();
+    chip8->setQuirks(profile);
+    if (data[0] & 0x4) chip8->clock = ClockModel::vip();
+
+    const uint8_t* rom = data + 1;
+    size_t romSize = std::min(size - 1, Chip8::MEMORY_SIZE - 0x200);
+    memcpy(&chip8->ram[0x200], rom, romSize);
+    chip8->loadFonts(*chip8, chip8->ram);
+    chip8->v_reg.fill(0);
+
+    RomAnalysis analysis = analyzeRom(chip8->ram, 0x200, profile);
+    chip8->translate(analysis);
+
+    for (int frame = 0; frame < FUZZ_FRAMES; frame++) {
+        // reuse the rom bytes as key presses, each frame sees a different pair
+        chip8->keypad = romSize ? rom[(frame * 2) % romSize] << 8 | rom[(frame * 2 + 1) % romSize] : 0;
+        chip8->runFrame();
+        chip8->tickTimers();
+    }
+    return 0;
+}
+
+#ifdef CHIP8_FUZZ_MAIN
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+int main(int argc, char** argv) {
+    auto runOne = [](std::istream& in) {
+        std::vector<uint8_t> input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+    };
+    if (argc < 2) {
+        runOne(std::cin);
+        return 0;
+    }
+    for (int i = 1; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (!file) {
+            std::cerr << "Error: Failed to open file " << argv[i] << std::endl;
+            return 1;
+        }
+        runOne(file);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,476 @@
+#include "gdbstub.h"
+#include "definitions.h"
+#include "debugger.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// how many frames to run between checks for a ctrl-c from the client
+static constexpr int INTERRUPT_POLL_FRAMES = 256;
+static constexpr int SIGINT_GDB = 2;
+static constexpr int SIGTRAP_GDB = 5;
+static constexpr int SIGSEGV_GDB = 11;
+
+namespace {
+
+const char HEX[] = "0123456789abcdef";
+
+void putHex(std::string& out, uint8_t byte) {
+    out += HEX[byte >> 4];
+    out += HEX[byte & 0xF];
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// two hex digits at `at`, -1 if there aren't
+int getHex(const std::string& in, size_t at) {
+    if (at + 1 >= in.size()) return -1;
+    int hi = hexDigit(in[at]), lo = hexDigit(in[at + 1]);
+    return hi < 0 || lo < 0 ? -1 : hi << 4 | lo;
+}
+
+// served through qXfer:features:read so gdb doesn't lay its own architecture's registers
+// over the g packet. same order and sizes as readRegister(), pc is the code pointer
+const char TARGET_XML[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<feature name=\"org.chip8.core\">"
+    "<reg name=\"v0\" bitsize=\"8\" regnum=\"0\" type=\"uint8\"/>"
+    "<reg name=\"v1\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v2\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v3\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v4\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v5\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v6\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v7\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v8\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"v9\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"va\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"vb\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"vc\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"vd\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"ve\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"vf\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>"
+    "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\" generic=\"pc\"/>"
+    "<reg name=\"sp\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"dt\" bitsize=\"8\" type=\"uint8\"/>"
+    "<reg name=\"st\" bitsize=\"8\" type=\"uint8\"/>"
+    "</feature>"
+    "</target>";
+
+std::string signalReply(int signal) {
+    std::string reply = "S";
+    putHex(reply, (uint8_t)signal);
+    return reply;
+}
+
+} // namespace
+
+GdbStub::GdbStub(Chip8& chip8, Debugger& debugger) : chip8(chip8), debugger(debugger) {}
+
+GdbStub::~GdbStub() {
+    closeSocket(client);
+    closeSocket(server);
+#ifdef _WIN32
+    WSACleanup();
+#else
+    if (!unixPath.empty()) unlink(unixPath.c_str());
+#endif
+}
+
+void GdbStub::closeSocket(Socket& s) {
+    if (s < 0) return;
+#ifdef _WIN32
+    closesocket((SOCKET)s);
+#else
+    close((int)s);
+#endif
+    s = -1;
+}
+
+bool GdbStub::listen(const std::string& where) {
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        std::cerr << "Error: WSAStartup failed" << std::endl;
+        return false;
+    }
+#endif
+    char* end = nullptr;
+    unsigned long port = strtoul(where.c_str(), &end, 10);
+    bool tcp = end != where.c_str() && *end == '\0';
+
+    if (tcp) {
+        if (port == 0 || port > 65535) {
+            std::cerr << "Error: bad gdb port " << where << std::endl;
+            return false;
+        }
+        server = (Socket)socket(AF_INET, SOCK_STREAM, 0);
+        if (server < 0) {
+            std::cerr << "Error: can't create socket" << std::endl;
+            return false;
+        }
+        int yes = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+        // localhost only, there's no authentication in rsp
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(server, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            std::cerr << "Error: can't bind 127.0.0.1:" << port << std::endl;
+            return false;
+        }
+    } else {
+#ifdef _WIN32
+        std::cerr << "Error: --gdb needs a port number on windows" << std::endl;
+        return false;
+#else
+        sockaddr_un addr{};
+        if (where.size() >= sizeof(addr.sun_path)) {
+            std::cerr << "Error: socket path too long " << where << std::endl;
+            return false;
+        }
+        server = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server < 0) {
+            std::cerr << "Error: can't create socket" << std::endl;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, where.c_str());
+        unlink(where.c_str());
+        if (bind(server, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            std::cerr << "Error: can't bind " << where << std::endl;
+            return false;
+        }
+        unixPath = where;
+#endif
+    }
+
+    if (::listen(server, 1) != 0) {
+        std::cerr << "Error: listen failed" << std::endl;
+        return false;
+    }
+    std::cout << "Waiting for gdb on " << (tcp ? "127.0.0.1:" : "") << where << std::endl;
+    return true;
+}
+
+void GdbStub::serve() {
+    client = (Socket)accept(server, nullptr, nullptr);
+    if (client < 0) {
+        std::cerr << "Error: accept failed" << std::endl;
+        return;
+    }
+    if (unixPath.empty()) {
+        // packets are tiny and strictly request/reply, don't let nagle sit on them
+        int yes = 1;
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+    }
+    std::cout << "gdb connected" << std::endl;
+
+    std::string packet;
+    while (readPacket(packet)) {
+        if (!handle(packet)) break;
+    }
+    closeSocket(client);
+    std::cout << "gdb disconnected" << std::endl;
+}
+
+// appends whatever the client sent. with block = false it returns right away when there's
+// nothing. false when the connection is gone
+bool GdbStub::fill(bool block) {
+    if (!block) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(client, &readable);
+        timeval zero{0, 0};
+        if (select((int)client + 1, &readable, nullptr, nullptr, &zero) <= 0) return true;
+    }
+    char buffer[4096];
+    int n = recv(client, buffer, sizeof(buffer), 0);
+    if (n <= 0) return false;
+    input.append(buffer, n);
+    return true;
+}
+
+// $payload#cs. acks and stray ctrl-c outside of a continue are dropped, a bad checksum
+// gets a '-' so the client resends
+bool GdbStub::readPacket(std::string& packet) {
+    while (true) {
+        size_t start = input.find('$');
+        if (start != std::string::npos) {
+            size_t hash = input.find('#', start);
+            if (hash != std::string::npos && hash + 2 < input.size()) {
+                packet = input.substr(start + 1, hash - start - 1);
+                int expected = getHex(input, hash + 1);
+                input.erase(0, hash + 3);
+
+                uint8_t sum = 0;
+                for (char c : packet) sum += (uint8_t)c;
+                const char* ack = expected == sum ? "+" : "-";
+                ::send(client, ack, 1, 0);
+                if (expected == sum) return true;
+                continue;
+            }
+        } else {
+            input.clear();
+        }
+        if (!fill(true)) return false;
+    }
+}
+
+void GdbStub::send(const std::string& payload) {
+    uint8_t sum = 0;
+    for (char c : payload) sum += (uint8_t)c;
+    std::string out = "$" + payload + "#";
+    putHex(out, sum);
+    ::send(client, out.data(), (int)out.size(), 0);
+}
+
+bool GdbStub::handle(const std::string& packet) {
+    if (packet.empty()) {
+        send("");
+        return true;
+    }
+    std::string args = packet.substr(1);
+    switch (packet[0]) {
+        case '?': send(lastStop); break;
+        case 'g': send(readRegisters()); break;
+        case 'G': send(writeRegisters(args) ? "OK" : "E01"); break;
+        case 'p': send(readRegister((int)strtol(args.c_str(), nullptr, 16))); break;
+        case 'P': {
+            size_t eq = args.find('=');
+            bool ok = eq != std::string::npos
+                      && writeRegister((int)strtol(args.c_str(), nullptr, 16), args.substr(eq + 1));
+            send(ok ? "OK" : "E01");
+            break;
+        }
+        case 'm': send(readMemory(args)); break;
+        case 'M': send(writeMemory(args) ? "OK" : "E01"); break;
+        case 'c':
+            if (!args.empty()) chip8.pc = (uint16_t)strtoul(args.c_str(), nullptr, 16);
+            send(resume());
+            break;
+        case 's':
+            if (!args.empty()) chip8.pc = (uint16_t)strtoul(args.c_str(), nullptr, 16);
+            send(step());
+            break;
+        case 'Z': send(breakpoint(args, true)); break;
+        case 'z': send(breakpoint(args, false)); break;
+        case 'H': send("OK"); break;
+        case 'T': send("OK"); break;
+        case 'k': return false;
+        case 'D':
+            send("OK");
+            return false;
+        case 'q':
+            if (packet.rfind("qSupported", 0) == 0) send("PacketSize=1000;qXfer:features:read+");
+            else if (packet.rfind("qXfer:features:read:", 0) == 0) send(readFeatures(packet.substr(20)));
+            else if (packet == "qAttached") send("1");
+            else if (packet == "qC") send("QC1");
+            else if (packet == "qfThreadInfo") send("m1");
+            else if (packet == "qsThreadInfo") send("l");
+            else send("");
+            break;
+        default:
+            // not supported, an empty reply tells the client to fall back
+            send("");
+            break;
+    }
+    return true;
+}
+
+std::string GdbStub::resume() {
+    debugger.stopped = Debugger::Stop::NONE;
+    for (int frame = 1;; frame++) {
+        chip8.runFrame();
+        if (debugger.stopped != Debugger::Stop::NONE) break;
+        chip8.tickTimers();
+        if (frame % INTERRUPT_POLL_FRAMES == 0 && interrupted()) {
+            lastStop = signalReply(SIGINT_GDB);
+            return lastStop;
+        }
+    }
+    return stopReply();
+}
+
+std::string GdbStub::step() {
+    debugger.step();
+    debugger.stopped = Debugger::Stop::NONE;
+    lastStop = signalReply(SIGTRAP_GDB);
+    return lastStop;
+}
+
+// the debugger stops before the access, gdb expects a watchpoint to report after it, so
+// the instruction gets run first
+std::string GdbStub::stopReply() {
+    Debugger::Stop reason = debugger.stopped;
+    uint16_t addr = debugger.watchAddr;
+    debugger.stopped = Debugger::Stop::NONE;
+
+    std::string reply = "T";
+    putHex(reply, reason == Debugger::Stop::STACK_FAULT ? SIGSEGV_GDB : SIGTRAP_GDB);
+    if (reason == Debugger::Stop::WATCH_READ || reason == Debugger::Stop::WATCH_WRITE) {
+        bool both = debugger.watchFlags(addr) == (Debugger::WATCH_READ | Debugger::WATCH_WRITE);
+        debugger.step();
+        debugger.stopped = Debugger::Stop::NONE;
+        reply += both ? "awatch:" : reason == Debugger::Stop::WATCH_WRITE ? "watch:" : "rwatch:";
+        char hex[8];
+        snprintf(hex, sizeof(hex), "%x", addr);
+        reply += hex;
+        reply += ";";
+    }
+    lastStop = reply;
+    return reply;
+}
+
+// ctrl-c arrives as a bare 0x03 outside of any packet
+bool GdbStub::interrupted() {
+    if (!fill(false)) return true;
+    size_t at = input.find('\x03');
+    if (at == std::string::npos) return false;
+    input.erase(at, 1);
+    return true;
+}
+
+std::string GdbStub::readRegister(int reg) const {
+    std::string out;
+    if (reg < 0 || reg >= REG_COUNT) return "E01";
+    auto le16 = [&](uint16_t value) {
+        putHex(out, value & 0xFF);
+        putHex(out, value >> 8);
+    };
+    if (reg < (int)Chip8::REGS) putHex(out, chip8.v_reg[reg]);
+    else if (reg == REG_I) le16(chip8.i_reg);
+    else if (reg == REG_PC) le16(chip8.pc);
+    else if (reg == REG_SP) le16(chip8.sp);
+    else if (reg == REG_DT) putHex(out, chip8.dt);
+    else putHex(out, chip8.st);
+    return out;
+}
+
+bool GdbStub::writeRegister(int reg, const std::string& hex) {
+    if (reg < 0 || reg >= REG_COUNT) return false;
+    int lo = getHex(hex, 0);
+    if (lo < 0) return false;
+    int hi = getHex(hex, 2);
+    uint16_t wide = (uint16_t)(lo | (hi < 0 ? 0 : hi << 8));
+
+    if (reg < (int)Chip8::REGS) chip8.v_reg[reg] = (uint8_t)lo;
+    else if (reg == REG_I) chip8.i_reg = wide;
+    else if (reg == REG_PC) chip8.pc = wide;
+    else if (reg == REG_SP) chip8.sp = wide < Chip8::STACK_SIZE ? wide : Chip8::STACK_SIZE;
+    else if (reg == REG_DT) chip8.dt = (uint8_t)lo;
+    else chip8.st = (uint8_t)lo;
+    return true;
+}
+
+std::string GdbStub::readRegisters() const {
+    std::string out;
+    for (int reg = 0; reg < REG_COUNT; reg++) out += readRegister(reg);
+    return out;
+}
+
+bool GdbStub::writeRegisters(const std::string& hex) {
+    size_t at = 0;
+    for (int reg = 0; reg < REG_COUNT; reg++) {
+        size_t width = (reg == REG_I || reg == REG_PC || reg == REG_SP) ? 4 : 2;
+        if (at + width > hex.size()) return false;
+        if (!writeRegister(reg, hex.substr(at, width))) return false;
+        at += width;
+    }
+    return true;
+}
+
+// "annex:offset,length". 'm' and a chunk while there's more, 'l' with the last one
+std::string GdbStub::readFeatures(const std::string& args) const {
+    size_t colon = args.find(':');
+    if (colon == std::string::npos) return "E00";
+    if (args.substr(0, colon) != "target.xml") return "E00";
+    char* end = nullptr;
+    unsigned long offset = strtoul(args.c_str() + colon + 1, &end, 16);
+    if (*end != ',') return "E00";
+    unsigned long length = strtoul(end + 1, nullptr, 16);
+
+    // the xml has none of the characters that would need escaping in a binary reply
+    const size_t size = sizeof(TARGET_XML) - 1;
+    if (offset >= size) return "l";
+    std::string chunk(TARGET_XML + offset, std::min<size_t>(length, size - offset));
+    return (offset + chunk.size() < size ? "m" : "l") + chunk;
+}
+
+// "addr,length", the address wraps around the 64k
+std::string GdbStub::readMemory(const std::string& args) const {
+    char* end = nullptr;
+    unsigned long addr = strtoul(args.c_str(), &end, 16);
+    if (*end != ',') return "E01";
+    unsigned long length = strtoul(end + 1, nullptr, 16);
+    if (length > Chip8::MEMORY_SIZE) return "E01";
+    std::string out;
+    for (unsigned long i = 0; i < length; i++) putHex(out, chip8.ram[(uint16_t)(addr + i)]);
+    return out;
+}
+
+// "addr,length:bytes". goes through writeRam so patched code gets retranslated
+bool GdbStub::writeMemory(const std::string& args) {
+    char* end = nullptr;
+    unsigned long addr = strtoul(args.c_str(), &end, 16);
+    if (*end != ',') return false;
+    unsigned long length = strtoul(end + 1, &end, 16);
+    if (*end != ':') return false;
+    std::string data = end + 1;
+    if (data.size() < length * 2) return false;
+    for (unsigned long i = 0; i < length; i++) {
+        chip8.writeRam((uint16_t)(addr + i), (uint8_t)getHex(data, i * 2));
+    }
+    return true;
+}
+
+// "type,addr,kind". 0/1 are breakpoints, 2/3/4 write/read/access watchpoints of kind bytes
+std::string GdbStub::breakpoint(const std::string& args, bool insert) {
+    char* end = nullptr;
+    int type = (int)strtol(args.c_str(), &end, 16);
+    if (*end != ',') return "E01";
+    unsigned long addr = strtoul(end + 1, &end, 16);
+    if (*end != ',' || addr >= Chip8::MEMORY_SIZE) return "E01";
+    unsigned long length = strtoul(end + 1, nullptr, 16);
+
+    uint8_t watch = 0;
+    switch (type) {
+        case 0:
+        case 1:
+            if (insert) debugger.addBreakpoint((uint16_t)addr);
+            else debugger.removeBreakpoint((uint16_t)addr);
+            return "OK";
+        case 2: watch = Debugger::WATCH_WRITE; break;
+        case 3: watch = Debugger::WATCH_READ; break;
+        case 4: watch = Debugger::WATCH_READ | Debugger::WATCH_WRITE; break;
+        default: return "";
+    }
+    if (length == 0 || length > 0xFFFF) return "E01";
+    if (insert) debugger.addWatchpoint((uint16_t)addr, (uint16_t)length, watch);
+    else debugger.removeWatchpoint((uint16_t)addr, (uint16_t)length, watch);
+    return "OK";
+}
@@ -0,0 +1,80 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <cstdint>
+#include <string>
+
+class Chip8;
+class Debugger;
+
+// gdb remote serial protocol server (--gdb). gdb has no chip8 target so the register
+// file is our own, in this order for g/G and p/P:
+//   0-15  V0..VF   1 byte each
+//   16    I        2 bytes, little endian
+//   17    PC       2 bytes
+//   18    SP       2 bytes (stack depth, the stack itself isn't in ram)
+//   19    DT       1 byte
+//   20    ST       1 byte
+// gdb learns this layout from the target.xml served through qXfer:features:read.
+// memory is the whole 64k ram. Z0/Z1 set breakpoints and Z2/Z3/Z4 write/read/access
+// watchpoints through the Debugger, so they cost nothing while none are set. the machine
+// runs unpaced while continuing, ctrl-c from the client stops it
+class GdbStub {
+public:
+    static constexpr int REG_I = 16;
+    static constexpr int REG_PC = 17;
+    static constexpr int REG_SP = 18;
+    static constexpr int REG_DT = 19;
+    static constexpr int REG_ST = 20;
+    static constexpr int REG_COUNT = 21;
+
+    GdbStub(Chip8& chip8, Debugger& debugger);
+    ~GdbStub();
+    GdbStub(const GdbStub&) = delete;
+    GdbStub& operator=(const GdbStub&) = delete;
+
+    // a number listens on 127.0.0.1:<port>, anything else is a unix socket path
+    bool listen(const std::string& where);
+    // waits for one client and serves it until it detaches, kills us or hangs up
+    void serve();
+
+private:
+    using Socket = intptr_t;
+
+    Chip8& chip8;
+    Debugger& debugger;
+    Socket server = -1;
+    Socket client = -1;
+    std::string unixPath;
+    // received bytes not consumed yet
+    std::string input;
+
+    bool readPacket(std::string& packet);
+    bool fill(bool block);
+    void send(const std::string& payload);
+    // false once the session is over
+    bool handle(const std::string& packet);
+
+    std::string stopReply();
+    // runs frames until the debugger stops us or the client interrupts
+    std::string resume();
+    std::string step();
+    bool interrupted();
+
+    std::string readRegisters() const;
+    bool writeRegisters(const std::string& hex);
+    std::string readRegister(int reg) const;
+    bool writeRegister(int reg, const std::string& hex);
+    std::string readMemory(const std::string& args) const;
+    bool writeMemory(const std::string& args);
+    std::string breakpoint(const std::string& args, bool insert);
+    // qXfer:features:read, the target.xml describing the registers above
+    std::string readFeatures(const std::string& args) const;
+
+    // answer to '?', the reason of the last stop
+    std::string lastStop = "S05";
+
+    void closeSocket(Socket& s);
+};
+
+#endif // GDBSTUB_H
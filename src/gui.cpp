@@ -1,9 +1,12 @@
 #include "gui.h"
 #include "font_data.h"
+#include "debugger.h"
+#include "tiles.h"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <atomic>
+#include <unordered_map>
 #include <SDL2/SDL_ttf.h>
 
 const int WINDOW_WIDTH = 640;
@@ -14,6 +17,7 @@ const int DEBUG_WINDOW_HEIGHT = 600;
 static std::string lastDebugText = "";
 static SDL_Texture* debugTextTexture = nullptr;
 static SDL_Texture* debugWindowTexture = nullptr;
+static SDL_Texture* atlasTexture = nullptr;
 
 SDL_Window* window = nullptr;
 SDL_Renderer* renderer = nullptr;
@@ -23,9 +27,31 @@ SDL_Renderer* debugRenderer = nullptr;
 TTF_Font* font = nullptr;
 
 bool paused = false;
+bool showOverlay = false;
+KeypadInput keypadInput;
+InputLatency inputLatency;
+KeyMap keyMap;
+Scaler scaler;
+PresentPolicy presentPolicy;
+// open controllers by joystick instance id, closed again when unplugged
+static std::unordered_map<SDL_JoystickID, SDL_GameController*> controllers;
+
+void renderText(SDL_Renderer* renderer, const std::string& text, int x, int y);
+
+static bool visible(SDL_Window* w) {
+    return w && !(SDL_GetWindowFlags(w) & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED));
+}
+
+// again whenever the main window moves, it may have landed on another display
+static void updateRefreshRate() {
+    SDL_DisplayMode mode;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0) {
+        presentPolicy.setRefreshRate(mode.refresh_rate);
+    }
+}
 
 bool initSDL() {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMECONTROLLER) < 0) {
         SDL_Log("SDL could not initialize! SDL_Error: %s", SDL_GetError());
         return false;
     }
@@ -51,13 +77,16 @@ bool initSDL() {
         return false;
     }
 
-    window = SDL_CreateWindow("Chip8", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
+    window = SDL_CreateWindow("Chip8", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
     debugWindow = SDL_CreateWindow("Chip8 Debug", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, DEBUG_WINDOW_WIDTH, DEBUG_WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
 
     if (!window || !debugWindow) {
         SDL_Log("Window could not be created! SDL_Error: %s", SDL_GetError());
         return false;
     }
+    // small enough for a hires frame at 1x, anything bigger scales by whole multiples
+    SDL_SetWindowMinimumSize(window, Chip8::HIRES_WIDTH, Chip8::HIRES_HEIGHT);
+    updateRefreshRate();
 
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     debugRenderer = SDL_CreateRenderer(debugWindow, -1, SDL_RENDERER_ACCELERATED);
@@ -67,29 +96,156 @@ bool initSDL() {
         return false;
     }
 
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, Chip8::DISPLAY_WIDTH, Chip8::DISPLAY_HEIGHT);
+    // sized for schip hires, lores frames only fill the top-left corner
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, Chip8::HIRES_WIDTH, Chip8::HIRES_HEIGHT);
     return true;
 }
 
-void render(const Chip8& chip8) {
-    if (!chip8.displayChanged) return;
-    uint32_t pixels[Chip8::DISPLAY_WIDTH * Chip8::DISPLAY_HEIGHT];
-
-    for (size_t i = 0; i < Chip8::DISPLAY_WIDTH * Chip8::DISPLAY_HEIGHT; i++) {
-        pixels[i] = chip8.display[i] ? 0xFFFFFFFF : 0x000000;
+// F3 overlay: the last frame as a bar across the top, one colored segment per zone, scaled
+// so the full window width is one 60hz frame. the white tick is the p99 busy time
+static void renderOverlay(const Profiler& profiler, int windowWidth) {
+    static const SDL_Color colors[ZONE_COUNT] = {
+        {0, 0, 0, 0}, {80, 160, 255, 255}, {90, 220, 90, 255}, {255, 200, 60, 255},
+        {220, 90, 220, 255}, {255, 110, 80, 255}, {60, 60, 60, 255},
+    };
+    const double budget = 1e9 / 60;
+    const int barHeight = 12;
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_Rect background = {0, 0, windowWidth, barHeight + 24};
+    SDL_RenderFillRect(renderer, &background);
+
+    double x = 0;
+    for (int zone = ZONE_INPUT; zone < ZONE_COUNT; zone++) {
+        double width = profiler.last[zone] / budget * windowWidth;
+        SDL_SetRenderDrawColor(renderer, colors[zone].r, colors[zone].g, colors[zone].b, colors[zone].a);
+        SDL_Rect segment = {(int)x, 0, std::max(1, (int)width), barHeight};
+        SDL_RenderFillRect(renderer, &segment);
+        x += width;
     }
 
-    SDL_UpdateTexture(texture, nullptr, pixels, Chip8::DISPLAY_WIDTH * sizeof(uint32_t));
+    const Histogram& frame = profiler.histograms[ZONE_FRAME];
+    const Histogram& sleep = profiler.histograms[ZONE_SLEEP];
+    double busyP99 = frame.percentile(0.99) - sleep.percentile(0.01);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_Rect tick = {(int)(busyP99 / budget * windowWidth), 0, 2, barHeight};
+    SDL_RenderFillRect(renderer, &tick);
+
+    std::stringstream text;
+    text << std::fixed << std::setprecision(2)
+         << "frame p50 " << frame.percentile(0.5) / 1e6 << " ms  p99 " << frame.percentile(0.99) / 1e6
+         << " ms  busy " << (profiler.last[ZONE_FRAME] - profiler.last[ZONE_SLEEP]) / budget * 100 << "%";
+    renderText(renderer, text.str(), 4, barHeight + 2);
+}
 
-    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+bool render(const Chip8& chip8, const Profiler* overlay) {
+    if (!chip8.displayChanged && !overlay && !scaler.fading()) return false;
+    // a hidden window gets redrawn from scratch when it's shown again
+    if (!visible(window)) return false;
+    auto now = PresentPolicy::Clock::now();
+    if (!presentPolicy.due(now)) {
+        presentPolicy.deferred++;
+        return false;
+    }
+    const Display& display = chip8.presented();
+    SDL_Rect area = {0, 0, (int)display.width, (int)display.height};
+    uint64_t dirtyRows = display.dirtyRows;
+    display.dirtyRows = 0;
+
+    // the largest whole multiple that fits, centered with black bars so pixels stay square
+    int outputWidth, outputHeight;
+    SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+    int scale = Scaler::fitScale(outputWidth, outputHeight, display.width, display.height);
+    SDL_Rect target = {(outputWidth - area.w * scale) / 2, (outputHeight - area.h * scale) / 2,
+                       area.w * scale, area.h * scale};
+
+    SDL_Texture* source = texture;
+    if (scaler.active()) {
+        // filters are baked into a texture at the final size, copied 1:1
+        scaler.update(renderer, display, dirtyRows, scale);
+        source = scaler.texture;
+        area = {0, 0, target.w, target.h};
+    } else if (chip8.displayChanged) {
+        // the overlay redraws every frame, the texture only needs a new upload when the core drew
+        uint32_t pixels[Chip8::HIRES_WIDTH * Chip8::HIRES_HEIGHT];
+        for (size_t y = 0; y < display.height; y++) {
+            Display::Row plane0 = display.row(y, 0);
+            Display::Row plane1 = display.row(y, 1);
+            for (size_t x = 0; x < display.width; x++) {
+                int shift = Display::MAX_WIDTH - 1 - x;
+                int index = ((plane0 >> shift) & 1) | (((plane1 >> shift) & 1) << 1);
+                pixels[y * display.width + x] = Display::PALETTE[index];
+            }
+        }
+        SDL_UpdateTexture(texture, &area, pixels, display.width * sizeof(uint32_t));
+    }
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, source, &area, &target);
+    if (overlay) renderOverlay(*overlay, outputWidth);
     SDL_RenderPresent(renderer); // Update only when necessary
+    presentPolicy.lastPresent = now;
+    presentPolicy.presented++;
 
     // Reset displayChanged flag to avoid redundant rendering
     chip8.displayChanged = false;
+    return true;
 }
 
 
 
+bool renderTiles(TileGrid& grid, bool redraw) {
+    if (!atlasTexture) {
+        atlasTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                         grid.atlasWidth, grid.atlasHeight);
+        if (!atlasTexture) return false;
+        // there's no single machine to show registers for
+        SDL_HideWindow(debugWindow);
+        redraw = true;
+    }
+    auto [first, end] = grid.dirtySpan();
+    if (first == end && !redraw) return false;
+    // dirty tiles stay dirty until they can be shown
+    if (!visible(window)) return false;
+    auto now = PresentPolicy::Clock::now();
+    if (!presentPolicy.due(now)) {
+        presentPolicy.deferred++;
+        return false;
+    }
+
+    if (first != end) {
+        SDL_Rect rows = {0, (int)first, (int)grid.atlasWidth, (int)(end - first)};
+        SDL_UpdateTexture(atlasTexture, &rows, &grid.atlas[first * grid.atlasWidth], grid.atlasWidth * sizeof(uint32_t));
+        grid.clearDirty();
+    }
+
+    // whole multiples while the atlas fits, shrunk to fit (keeping the aspect) once it doesn't
+    int outputWidth, outputHeight;
+    SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+    SDL_Rect target;
+    if ((size_t)outputWidth >= grid.atlasWidth && (size_t)outputHeight >= grid.atlasHeight) {
+        int scale = Scaler::fitScale(outputWidth, outputHeight, grid.atlasWidth, grid.atlasHeight);
+        target.w = grid.atlasWidth * scale;
+        target.h = grid.atlasHeight * scale;
+    } else {
+        double scale = std::min((double)outputWidth / grid.atlasWidth, (double)outputHeight / grid.atlasHeight);
+        target.w = (int)(grid.atlasWidth * scale);
+        target.h = (int)(grid.atlasHeight * scale);
+    }
+    target.x = (outputWidth - target.w) / 2;
+    target.y = (outputHeight - target.h) / 2;
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, atlasTexture, nullptr, &target);
+    SDL_RenderPresent(renderer);
+    presentPolicy.lastPresent = now;
+    presentPolicy.presented++;
+    return true;
+}
+
 void renderText(SDL_Renderer* renderer, const std::string& text, int x, int y) {
     if (!font) return;
 
@@ -106,6 +262,8 @@ void renderText(SDL_Renderer* renderer, const std::string& text, int x, int y) {
 }
 
 void renderDebugInfo(const Chip8& chip8) {
+    if (!visible(debugWindow)) return;
+
     std::stringstream debugText;
     debugText << "PC: 0x" << std::hex << std::setw(3) << std::setfill('0') << chip8.pc << "\n";
     debugText << "I: 0x" << std::hex << std::setw(3) << std::setfill('0') << chip8.i_reg << "\n";
@@ -123,9 +281,9 @@ void renderDebugInfo(const Chip8& chip8) {
                   << chip8.stack[i] << "\n";
     }
 
-    for (size_t i = 0; i < chip8.keypad.size(); i++) {
+    for (size_t i = 0; i < Chip8::KEYS; i++) {
         debugText << "Keypad: 0x"
-                  << std::hex << i << ": " << chip8.keypad[i] << "\n";
+                  << std::hex << i << ": " << ((chip8.keypad >> i) & 1) << "\n";
     }
 
     std::string newDebugText = debugText.str();
@@ -150,10 +308,12 @@ void renderDebugInfo(const Chip8& chip8) {
 
     SDL_SetRenderTarget(debugRenderer, nullptr);
     SDL_FreeSurface(surface);
+    presentPolicy.debugChanged = true;
 }
 
 void renderDebugWindow() {
-    if (!debugWindowTexture) return;
+    if (!debugWindowTexture || !presentPolicy.debugChanged || !visible(debugWindow)) return;
+    presentPolicy.debugChanged = false;
 
     SDL_SetRenderDrawColor(debugRenderer, 0, 0, 0, 255);
     SDL_RenderClear(debugRenderer);
@@ -164,6 +324,8 @@ void renderDebugWindow() {
 
 void cleanupSDL() {
     SDL_DestroyTexture(texture);
+    if (scaler.texture) SDL_DestroyTexture(scaler.texture);
+    if (atlasTexture) SDL_DestroyTexture(atlasTexture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyRenderer(debugRenderer);
     SDL_DestroyWindow(window);
@@ -172,12 +334,13 @@ void cleanupSDL() {
         TTF_CloseFont(font);
         font = nullptr;
     }
+    for (auto& [id, controller] : controllers) SDL_GameControllerClose(controller);
+    controllers.clear();
     TTF_Quit();
     SDL_Quit();
 }
 
 void handleInput(std::atomic<bool>& running, Chip8& chip8) {
-    static bool prevKeypad[16] = {false};
     SDL_Event event;
 
     while (SDL_PollEvent(&event)) {
@@ -190,53 +353,90 @@ void handleInput(std::atomic<bool>& running, Chip8& chip8) {
                 std::cout << "SDL_WINDOWEVENT_CLOSE received!" << std::endl;
                 running.store(false);
             }
+            // a new size may change the scale, and either way the window has to be presented
+            // again. nothing was presented into it while it was hidden or minimized
+            bool debug = debugWindow && event.window.windowID == SDL_GetWindowID(debugWindow);
+            switch (event.window.event) {
+                case SDL_WINDOWEVENT_SIZE_CHANGED:
+                case SDL_WINDOWEVENT_EXPOSED:
+                case SDL_WINDOWEVENT_SHOWN:
+                case SDL_WINDOWEVENT_RESTORED:
+                    if (debug) presentPolicy.debugChanged = true;
+                    else chip8.displayChanged = true;
+                    break;
+                case SDL_WINDOWEVENT_MOVED:
+                    if (!debug) updateRefreshRate();
+                    break;
+            }
         } else if (event.type == SDL_KEYDOWN) {
             SDL_Scancode scancode = event.key.keysym.scancode;
             if (event.key.keysym.sym == SDLK_SPACE) {
                 paused = !paused;
                 std::cout << (paused ? "Emulator paused.\n" : "Emulator resumed.\n");
             }
+            if (event.key.keysym.sym == SDLK_F3) {
+                showOverlay = !showOverlay;
+            }
+            // F11 steps one instruction while paused, F10 steps over a call and shift+F11
+            // runs to the end of the subroutine, both stop on their own
+            if (chip8.debugger && (event.key.keysym.sym == SDLK_F10 || event.key.keysym.sym == SDLK_F11)) {
+                bool out = event.key.keysym.mod & KMOD_SHIFT;
+                if (event.key.keysym.sym == SDLK_F11 && !out) {
+                    if (paused) {
+                        chip8.debugger->step();
+                        chip8.debugger->printStop();
+                        chip8.debugger->stopped = Debugger::Stop::NONE;
+                        chip8.displayChanged = true;
+                    }
+                } else {
+                    if (out) chip8.debugger->stepOut();
+                    else chip8.debugger->stepOver();
+                    // a plain instruction under F10 was stepped right away
+                    if (chip8.debugger->stopped != Debugger::Stop::NONE) {
+                        chip8.debugger->printStop();
+                        chip8.debugger->stopped = Debugger::Stop::NONE;
+                        chip8.displayChanged = true;
+                    } else {
+                        paused = false;
+                    }
+                }
+            }
 
-            // scancodes
-            switch(scancode) {
-                case SDL_SCANCODE_1: chip8.keypad[0x1] = true; break;
-                case SDL_SCANCODE_2: chip8.keypad[0x2] = true; break;
-                case SDL_SCANCODE_3: chip8.keypad[0x3] = true; break;
-                case SDL_SCANCODE_4: chip8.keypad[0xC] = true; break;
-                case SDL_SCANCODE_Q: chip8.keypad[0x4] = true; break;
-                case SDL_SCANCODE_W: chip8.keypad[0x5] = true; break;
-                case SDL_SCANCODE_E: chip8.keypad[0x6] = true; break;
-                case SDL_SCANCODE_R: chip8.keypad[0xD] = true; break;
-                case SDL_SCANCODE_A: chip8.keypad[0x7] = true; break;
-                case SDL_SCANCODE_S: chip8.keypad[0x8] = true; break;
-                case SDL_SCANCODE_D: chip8.keypad[0x9] = true; break;
-                case SDL_SCANCODE_F: chip8.keypad[0xE] = true; break;
-                case SDL_SCANCODE_Z: chip8.keypad[0xA] = true; break;
-                case SDL_SCANCODE_X: chip8.keypad[0x0] = true; break;
-                case SDL_SCANCODE_C: chip8.keypad[0xB] = true; break;
-                case SDL_SCANCODE_V: chip8.keypad[0xF] = true; break;
+            int key = keyMap.key(scancode);
+            if (key >= 0 && !event.key.repeat) {
+                keypadInput.press(key);
+                // the event may have sat in the queue since the last poll, date it back
+                auto age = std::chrono::milliseconds(SDL_GetTicks() - event.key.timestamp);
+                inputLatency.pressed(chip8.frameCount, InputLatency::Clock::now() - age);
             }
         } else if (event.type == SDL_KEYUP) {
             SDL_Scancode scancode = event.key.keysym.scancode;
 
-            // scancodes
-            switch(scancode) {
-                case SDL_SCANCODE_1: chip8.keypad[0x1] = false; break;
-                case SDL_SCANCODE_2: chip8.keypad[0x2] = false; break;
-                case SDL_SCANCODE_3: chip8.keypad[0x3] = false; break;
-                case SDL_SCANCODE_4: chip8.keypad[0xC] = false; break;
-                case SDL_SCANCODE_Q: chip8.keypad[0x4] = false; break;
-                case SDL_SCANCODE_W: chip8.keypad[0x5] = false; break;
-                case SDL_SCANCODE_E: chip8.keypad[0x6] = false; break;
-                case SDL_SCANCODE_R: chip8.keypad[0xD] = false; break;
-                case SDL_SCANCODE_A: chip8.keypad[0x7] = false; break;
-                case SDL_SCANCODE_S: chip8.keypad[0x8] = false; break;
-                case SDL_SCANCODE_D: chip8.keypad[0x9] = false; break;
-                case SDL_SCANCODE_F: chip8.keypad[0xE] = false; break;
-                case SDL_SCANCODE_Z: chip8.keypad[0xA] = false; break;
-                case SDL_SCANCODE_X: chip8.keypad[0x0] = false; break;
-                case SDL_SCANCODE_C: chip8.keypad[0xB] = false; break;
-                case SDL_SCANCODE_V: chip8.keypad[0xF] = false; break;
+            int key = keyMap.key(scancode);
+            if (key >= 0) keypadInput.release(key);
+        } else if (event.type == SDL_CONTROLLERBUTTONDOWN) {
+            int key = keyMap.button(event.cbutton.button);
+            if (key >= 0) {
+                keypadInput.press(key);
+                auto age = std::chrono::milliseconds(SDL_GetTicks() - event.cbutton.timestamp);
+                inputLatency.pressed(chip8.frameCount, InputLatency::Clock::now() - age);
+            }
+        } else if (event.type == SDL_CONTROLLERBUTTONUP) {
+            int key = keyMap.button(event.cbutton.button);
+            if (key >= 0) keypadInput.release(key);
+        } else if (event.type == SDL_CONTROLLERDEVICEADDED) {
+            // sdl sends one of these for every pad already plugged in at startup too
+            if (SDL_GameController* controller = SDL_GameControllerOpen(event.cdevice.which)) {
+                SDL_JoystickID id = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(controller));
+                controllers[id] = controller;
+                const char* name = SDL_GameControllerName(controller);
+                std::cout << "Controller connected: " << (name ? name : "unknown") << std::endl;
+            }
+        } else if (event.type == SDL_CONTROLLERDEVICEREMOVED) {
+            auto it = controllers.find(event.cdevice.which);
+            if (it != controllers.end()) {
+                SDL_GameControllerClose(it->second);
+                controllers.erase(it);
             }
         }
     }
@@ -244,5 +444,23 @@ void handleInput(std::atomic<bool>& running, Chip8& chip8) {
 
 
 void updateDisplay(const Chip8& chip8) {
-    render(chip8);
+    render(chip8, nullptr);
+}
+
+void PresentPolicy::printReport() const {
+    if (presented == 0) return;
+    std::cout << "Presented " << std::dec << presented << " frames, " << deferred
+              << " changes held back to the host refresh" << std::endl;
+}
+
+void InputLatency::printReport() const {
+    if (frames.count == 0) return;
+    std::cout << "Input latency over " << frames.count << " presses:" << std::endl;
+    std::cout << std::fixed << std::setprecision(1) << std::dec
+              << "  frames: mean " << (double)frames.total / frames.count
+              << "  p50 " << frames.percentile(0.5) << "  p99 " << frames.percentile(0.99)
+              << "  max " << frames.max << std::endl;
+    std::cout << "  ms: mean " << ns.total / 1e6 / ns.count
+              << "  p50 " << ns.percentile(0.5) / 1e6 << "  p99 " << ns.percentile(0.99) / 1e6
+              << "  max " << ns.max / 1e6 << std::endl;
 }
@@ -2,12 +2,99 @@
 #define GUI_H
 
 #include "definitions.h"
+#include "profiler.h"
+#include "keymap.h"
+#include "scaler.h"
 #include <atomic>
+#include <chrono>
+
+class TileGrid;
+
+// the host keys as 16 bit masks, bit n = chip8 key n. events set bits as they arrive and
+// the emulator takes a snapshot right before every emulated frame. a key tapped and let go
+// between two snapshots still shows up held for one frame instead of getting lost
+struct KeypadInput {
+    std::atomic<uint16_t> held{0};
+    std::atomic<uint16_t> tapped{0};
+
+    void press(int key) {
+        held.fetch_or(1 << key, std::memory_order_relaxed);
+        tapped.fetch_or(1 << key, std::memory_order_relaxed);
+    }
+    void release(int key) {
+        held.fetch_and(~(1 << key), std::memory_order_relaxed);
+    }
+    uint16_t snapshot() {
+        return held.load(std::memory_order_relaxed) | tapped.exchange(0, std::memory_order_relaxed);
+    }
+};
+
+// key press to the first presented frame that changed after it, in emulated frames and
+// host time. it can't know the change was caused by the key, so it's an upper bound
+// for games that redraw on their own
+struct InputLatency {
+    using Clock = std::chrono::steady_clock;
+
+    Histogram frames;
+    Histogram ns;
+    bool pending = false;
+    uint64_t pressFrame = 0;
+    Clock::time_point pressTime;
+
+    void pressed(uint64_t frame, Clock::time_point when) {
+        if (pending) return;
+        pending = true;
+        pressFrame = frame;
+        pressTime = when;
+    }
+    void presented(uint64_t frame) {
+        if (!pending) return;
+        pending = false;
+        frames.add(frame - pressFrame);
+        ns.add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - pressTime).count());
+    }
+    void printReport() const;
+};
+
+// when the windows get presented. nothing is presented unless it changed, the main window
+// at most once per host refresh (its present waits for vsync and would hold up the
+// emulation loop otherwise), and neither window while it's hidden or minimized
+struct PresentPolicy {
+    using Clock = std::chrono::steady_clock;
+
+    // one refresh of the display the main window is on, zero when it doesn't say
+    Clock::duration refresh{0};
+    Clock::time_point lastPresent;
+    // the debug window has something new to show
+    bool debugChanged = false;
+    uint64_t presented = 0;
+    // changed frames that came in less than a refresh after the last present
+    uint64_t deferred = 0;
+
+    void setRefreshRate(int hz) {
+        refresh = hz > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / hz : Clock::duration(0);
+    }
+    // a quarter refresh of slack, a 60hz loop on a 60hz display must not lose every
+    // other frame to jitter
+    bool due(Clock::time_point now) const { return now - lastPresent >= refresh - refresh / 4; }
+    void printReport() const;
+};
 
 extern bool paused;
+extern bool showOverlay;
+extern KeypadInput keypadInput;
+extern InputLatency inputLatency;
+extern KeyMap keyMap;
+extern Scaler scaler;
+extern PresentPolicy presentPolicy;
 
 bool initSDL();
-void render(const Chip8& chip8);
+// overlay is the F3 frame timing bar, nullptr when it's off. true when it presented, a
+// change it held back stays in displayChanged for the next call
+bool render(const Chip8& chip8, const Profiler* overlay);
+// --grid, the atlas scaled into the main window. only the rows with dirty tiles are
+// uploaded, `redraw` presents again without anything new (resize, expose)
+bool renderTiles(TileGrid& grid, bool redraw);
 void cleanupSDL();
 void renderDebugInfo(const Chip8& chip8);
 void renderDebugWindow();
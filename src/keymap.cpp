@@ -0,0 +1,93 @@
+#include "keymap.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+KeyMap::KeyMap() {
+    scancodes.fill(-1);
+    buttons.fill(-1);
+
+    // the usual 1234/QWER/ASDF/ZXCV block mapped onto the hex keypad
+    scancodes[SDL_SCANCODE_1] = 0x1;
+    scancodes[SDL_SCANCODE_2] = 0x2;
+    scancodes[SDL_SCANCODE_3] = 0x3;
+    scancodes[SDL_SCANCODE_4] = 0xC;
+    scancodes[SDL_SCANCODE_Q] = 0x4;
+    scancodes[SDL_SCANCODE_W] = 0x5;
+    scancodes[SDL_SCANCODE_E] = 0x6;
+    scancodes[SDL_SCANCODE_R] = 0xD;
+    scancodes[SDL_SCANCODE_A] = 0x7;
+    scancodes[SDL_SCANCODE_S] = 0x8;
+    scancodes[SDL_SCANCODE_D] = 0x9;
+    scancodes[SDL_SCANCODE_F] = 0xE;
+    scancodes[SDL_SCANCODE_Z] = 0xA;
+    scancodes[SDL_SCANCODE_X] = 0x0;
+    scancodes[SDL_SCANCODE_C] = 0xB;
+    scancodes[SDL_SCANCODE_V] = 0xF;
+
+    // most games move with 2/4/6/8 and fire with 5
+    buttons[SDL_CONTROLLER_BUTTON_DPAD_UP] = 0x2;
+    buttons[SDL_CONTROLLER_BUTTON_DPAD_LEFT] = 0x4;
+    buttons[SDL_CONTROLLER_BUTTON_DPAD_RIGHT] = 0x6;
+    buttons[SDL_CONTROLLER_BUTTON_DPAD_DOWN] = 0x8;
+    buttons[SDL_CONTROLLER_BUTTON_A] = 0x5;
+    buttons[SDL_CONTROLLER_BUTTON_B] = 0x6;
+}
+
+void KeyMap::clearKey(int key) {
+    for (auto& k : scancodes) if (k == key) k = -1;
+    for (auto& k : buttons) if (k == key) k = -1;
+}
+
+static std::string trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+bool KeyMap::load(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Error: Failed to open keymap " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        auto bad = [&](const std::string& why) {
+            std::cerr << filename << ":" << lineNumber << ": " << why << std::endl;
+            return false;
+        };
+
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) return bad("expected KEY = inputs");
+        std::string keyName = trim(line.substr(0, eq));
+        if (keyName.size() != 1 || !isxdigit((unsigned char)keyName[0])) return bad("chip8 key must be one hex digit");
+        int key = std::stoi(keyName, nullptr, 16);
+
+        // the line replaces whatever the key had before
+        clearKey(key);
+        std::stringstream inputs(line.substr(eq + 1));
+        std::string name;
+        while (std::getline(inputs, name, ',')) {
+            name = trim(name);
+            if (name.empty()) continue;
+            if (name.rfind("pad:", 0) == 0) {
+                SDL_GameControllerButton button = SDL_GameControllerGetButtonFromString(name.c_str() + 4);
+                if (button == SDL_CONTROLLER_BUTTON_INVALID) return bad("unknown controller button " + name.substr(4));
+                buttons[button] = key;
+            } else {
+                SDL_Scancode scancode = SDL_GetScancodeFromName(name.c_str());
+                if (scancode == SDL_SCANCODE_UNKNOWN) return bad("unknown key " + name);
+                scancodes[scancode] = key;
+            }
+        }
+    }
+    return true;
+}
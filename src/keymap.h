@@ -0,0 +1,37 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <SDL2/SDL.h>
+
+// host keys and controller buttons to chip8 keys, one flat table each so an event is a
+// single indexed read. -1 means not mapped.
+// the file format is one chip8 key per line, then the host inputs for it: keyboard keys
+// by their SDL scancode name, controller buttons with a "pad:" prefix and the
+// SDL_GameController name. # starts a comment
+//   5 = W, Up, pad:dpup
+//   6 = E, pad:a
+// keys the file doesn't mention keep the default 1234/QWER/ASDF/ZXCV layout
+class KeyMap {
+public:
+    KeyMap();
+
+    // false (with the line on stderr) when the file can't be read or has a bad line
+    bool load(const std::string& filename);
+
+    // sdl scancodes are always below SDL_NUM_SCANCODES (512), the mask just keeps it a plain load
+    int key(SDL_Scancode scancode) const { return scancodes[scancode & (SDL_NUM_SCANCODES - 1)]; }
+    int button(int button) const {
+        return button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX ? buttons[button] : -1;
+    }
+
+    std::array<int8_t, SDL_NUM_SCANCODES> scancodes;
+    std::array<int8_t, SDL_CONTROLLER_BUTTON_MAX> buttons;
+
+private:
+    void clearKey(int key);
+};
+
+#endif // KEYMAP_H
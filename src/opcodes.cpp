@@ -1,9 +1,13 @@
 #include "definitions.h"
+#include "perf.h"
+#include "debugger.h"
 #include <iostream>
 #include <iomanip>
 #include <array>
 #include <sstream>
 #include <random>
+#include <cstdlib>
+#include <bit>
 
 // useful functions
 std::pair<uint8_t, bool> Chip8::wrapping_add(uint8_t a, uint8_t b) {
@@ -11,17 +15,29 @@ std::pair<uint8_t, bool> Chip8::wrapping_add(uint8_t a, uint8_t b) {
     return { static_cast<uint8_t>(sum & 0xFF), sum > 0xFF };
 }
 
+// the stack index is masked rather than checked, so overflow and underflow both wrap
+// around the 16 entries. going out of range only raises stackFault for runFrame to handle
 void Chip8::push(uint16_t val) {
-    stack[sp] = val;
+    stack[sp & (STACK_SIZE - 1)] = val;
     sp++;
+    stackFault |= sp > STACK_SIZE;
 }
 
 uint16_t Chip8::pop() {
-    if (sp > 0) {
-        sp -= 1;
-        return stack[sp];
-    } else {
-        return 1;
+    sp--;
+    // an empty stack wraps sp to 0xFFFF
+    stackFault |= sp > STACK_SIZE;
+    return stack[sp & (STACK_SIZE - 1)];
+}
+
+void Chip8::stackFaulted() {
+    stackFault = false;
+    stackFaults++;
+    // back into range, the wrapped entries are what the rom gets
+    sp &= STACK_SIZE - 1;
+    if (stackPolicy == StackPolicy::HALT || (stackPolicy == StackPolicy::TRAP && !debugger)) {
+        halted = true;
+        std::cerr << "Stack overflow or underflow near 0x" << std::hex << pc << std::dec << ", machine halted" << std::endl;
     }
 }
 
@@ -54,35 +70,48 @@ void Chip8::opcode_ANNN(uint16_t& op) {
 }
 
 // skip instructions
+template <typename Q>
+void Chip8::skip() {
+    // xo-chip F000 NNNN is 4 bytes long, skipping it means jumping over both words
+    if constexpr (Q::xoChip) {
+        if (loadWord<Q>(pc) == 0xF000) pc += 0x2;
+    }
+    pc += 0x2;
+}
+
+template <typename Q>
 void Chip8::opcode_3XNN(uint16_t& op) {
     uint16_t val = op & 0x00FF;
     uint16_t reg = (op & 0x0F00) >> 8;
     if (v_reg[reg] == val) {
-        pc += 0x2;
+        skip<Q>();
     }
 }
 
+template <typename Q>
 void Chip8::opcode_4XNN(uint16_t& op) {
     uint16_t val = op & 0x00FF;
     uint16_t reg = (op & 0x0F00) >> 8;
     if (v_reg[reg] != val) {
-        pc += 0x2;
+        skip<Q>();
     }
 }
 
+template <typename Q>
 void Chip8::opcode_5XY0(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     uint8_t y = (op & 0x00F0) >> 4;
     if (v_reg[x] == v_reg[y]) {
-        pc += 0x2;
+        skip<Q>();
     }
 }
 
+template <typename Q>
 void Chip8::opcode_9XY0(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     uint8_t y = (op & 0x00F0) >> 4;
     if (v_reg[x] != v_reg[y]) {
-        pc += 0x2;
+        skip<Q>();
     }
 }
 
@@ -97,9 +126,16 @@ void Chip8::opcode_2NNN(uint16_t& op) {
     pc = addr;
 }
 
+template <typename Q>
 void Chip8::opcode_BNNN(uint16_t& op) {
     uint16_t addr = op & 0x0FFF;
-    pc = addr + v_reg[0];
+    if constexpr (Q::jumpVX) {
+        // chip48/schip read this as BXNN, the offset comes from vx
+        uint8_t x = (op & 0x0F00) >> 8;
+        pc = addr + v_reg[x];
+    } else {
+        pc = addr + v_reg[0];
+    }
 }
 
 // 8___ instructions
@@ -109,28 +145,31 @@ void Chip8::opcode_8XY0(uint16_t& op) {
     v_reg[x] = v_reg[y];
 }
 
+template <typename Q>
 void Chip8::opcode_8XY1(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     uint8_t y = (op & 0x00F0) >> 4;
     v_reg[x] = v_reg[x] | v_reg[y];
     // cosmac vip quirk, vf is reset with 8XY1-3
-    v_reg[0xF] = 0x0;
+    if constexpr (Q::vfReset) v_reg[0xF] = 0x0;
 }
 
+template <typename Q>
 void Chip8::opcode_8XY2(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     uint8_t y = (op & 0x00F0) >> 4;
     v_reg[x] = v_reg[x] & v_reg[y];
     // cosmac vip quirk, vf is reset with 8XY1-3
-    v_reg[0xF] = 0x0;
+    if constexpr (Q::vfReset) v_reg[0xF] = 0x0;
 }
 
+template <typename Q>
 void Chip8::opcode_8XY3(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     uint8_t y = (op & 0x00F0) >> 4;
     v_reg[x] = v_reg[x] ^ v_reg[y];
     // cosmac vip quirk, vf is reset with 8XY1-3
-    v_reg[0xF] = 0x0;
+    if constexpr (Q::vfReset) v_reg[0xF] = 0x0;
 }
 
 void Chip8::opcode_8XY4(uint16_t& op) {
@@ -153,10 +192,11 @@ void Chip8::opcode_8XY5(uint16_t& op) {
     if (bit >= v_reg[y]) v_reg[0xF] = 1; else v_reg[0xF] = 0;
 }
 
+template <typename Q>
 void Chip8::opcode_8XY6(uint16_t& op) {
     uint8_t y = (op & 0x00F0) >> 4;
     uint8_t x = (op & 0x0F00) >> 8;
-    v_reg[x] = v_reg[y];
+    if constexpr (Q::shiftVY) v_reg[x] = v_reg[y];
     uint8_t bit = v_reg[x] & 0x1;
     v_reg[x] >>= 1;
     v_reg[0xF] = bit;
@@ -170,10 +210,11 @@ void Chip8::opcode_8XY7(uint16_t& op) {
     if (v_reg[y] >= temp_x) v_reg[0xF] = 1; else v_reg[0xF] = 0;
 }
 
+template <typename Q>
 void Chip8::opcode_8XYE(uint16_t& op) {
     uint8_t y = (op & 0x00F0) >> 4;
     uint8_t x = (op & 0x0F00) >> 8;
-    v_reg[x] = v_reg[y];
+    if constexpr (Q::shiftVY) v_reg[x] = v_reg[y];
     uint8_t bit = (v_reg[x] & 0x80) >> 7;
     v_reg[x] <<= 1;
     v_reg[0xF] = bit;
@@ -204,75 +245,76 @@ void Chip8::opcode_FX15(uint16_t& op) {
 void Chip8::opcode_FX18(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     st = v_reg[x];
+    setBuzzer(st > 0);
 }
 
+// vf is left alone, none of the profiles flag i going past 0xFFF. accesses through i wrap
+// at the address space like everything else
 void Chip8::opcode_FX1E(uint16_t &op) {
     uint8_t x = (op & 0x0F00) >> 8;
     i_reg += v_reg[x];
-    if (i_reg >= 0x1000) {
-        v_reg[0xF] = 1;
-    }
 }
 
 // keypad!!!!!!!!!!!
+// waits for a key to go down and come back up like the vip, VX only gets the key once it's
+// released. Chip8Batch does the same, lane by lane
 void Chip8::opcode_FX0A(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     if (!waitingForKey) {
-        for (uint8_t i = 0; i < 16; i++) {
-            if (keypad[i]) {
-                v_reg[x] = i;
-                waitingForKey = true;
-                waitingKey = i;
-                pc -= 2;
-                break;
-            }
+        if (keypad) {
+            waitingKey = std::countr_zero(keypad);
+            waitingForKey = true;
         }
         pc -= 0x2;
+    } else if ((keypad >> waitingKey) & 1) {
+        pc -= 0x2;
     } else {
-        if (!keypad[waitingKey]) {
-            waitingForKey = false;
-        } else {
-            pc -= 2;
-        }
+        v_reg[x] = waitingKey;
+        waitingForKey = false;
     }
 }
 
+template <typename Q>
 void Chip8::opcode_EX9E(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
-    if (keypad[v_reg[x]]) {
-        pc += 2;
+    if ((keypad >> (v_reg[x] & 0xF)) & 1) {
+        skip<Q>();
     }
 }
 
+template <typename Q>
 void Chip8::opcode_EXA1(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
-    if (!keypad[v_reg[x]]) {
-        pc += 2;
+    if (!((keypad >> (v_reg[x] & 0xF)) & 1)) {
+        skip<Q>();
     }
 }
 
+template <typename Q>
 void Chip8::opcode_FX55(uint16_t& op) {
     uint16_t addr = i_reg;
     uint8_t x = (op & 0x0F00) >> 8;
     for (uint8_t i = 0; i <= x; i++) {
-        ram[addr] = v_reg[i];
+        store<Q>(addr, v_reg[i]);
         addr += 0x1;
-        // cosmac vip quirk, index increases too
-        i_reg++;
     }
+    // cosmac vip quirk, index increases too
+    if constexpr (Q::memoryIncrement) i_reg += x + 1;
 }
 
+template <typename Q>
 void Chip8::opcode_FX65(uint16_t& op) {
     uint16_t addr = i_reg;
     uint8_t x = (op & 0x0F00) >> 8;
     for (uint8_t i = 0; i <= x; i++) {
-        v_reg[i] = ram[addr];
+        v_reg[i] = load<Q>(addr);
         addr += 0x1;
-        // cosmac vip quirk, index increases too
-        i_reg++;
     }
+    // cosmac vip quirk, index increases too
+    if constexpr (Q::memoryIncrement) i_reg += x + 1;
 }
 
+template <typename Q>
 void Chip8::opcode_FX33(uint16_t& op) {
     uint8_t x = (op & 0x0F00) >> 8;
     uint8_t val = v_reg[x];
@@ -283,32 +325,50 @@ void Chip8::opcode_FX33(uint16_t& op) {
     number[2] = val % 10;
 
     for (uint8_t i = 0; i <= 2; i++) {
-        ram[i_reg + i] = number[i];
+        store<Q>(i_reg + i, number[i]);
     }
 }
 
 
 // drawing stuff
+template <typename Q>
 void Chip8::opcode_DXYN(uint16_t& op) {
     uint8_t x_reg = (op & 0x0F00) >> 8;
     uint8_t y_reg = (op & 0x00F0) >> 4;
     uint8_t height = op & 0x000F;
-    v_reg[0xF] = 0;
-    uint8_t x_coord = v_reg[x_reg] & 63;
-    uint8_t y_coord = v_reg[y_reg] & 31;
+    uint8_t x_coord = v_reg[x_reg] & (display.width - 1);
+    uint8_t y_coord = v_reg[y_reg] & (display.height - 1);
     v_reg[0xF] = 0;
 
-    for (uint8_t row = 0; row < height; row++) {
-        uint8_t sprite_row = ram[i_reg + row];
-        for (uint8_t col = 0; col < 8; col++) {
-            if (sprite_row & (0x80 >> col)) {
-                int pixelX = (x_coord + col) % Chip8::DISPLAY_WIDTH;
-                int pixelY = (y_coord + row) % Chip8::DISPLAY_HEIGHT;
-                bool prevPixel = display[pixelY * Chip8::DISPLAY_WIDTH + pixelX];
-                if (prevPixel) v_reg[0xF] = 1;
-                setPixel(pixelX, pixelY, !prevPixel);
+    // schip DXY0 draws a 16x16 sprite, two bytes per row
+    size_t bits = 8;
+    if constexpr (Q::superChip) {
+        if (height == 0) {
+            height = 16;
+            bits = 16;
+        }
+    }
+
+    // xo-chip draws the sprite into every selected plane, each plane reading the next
+    // chunk of sprite data. planes that aren't selected cost nothing
+    uint16_t addr = i_reg;
+    for (size_t plane = 0; plane < Display::PLANES; plane++) {
+        if (!(display.selected & (1 << plane))) continue;
+
+        for (uint8_t row = 0; row < height; row++) {
+            size_t pixelY = y_coord + row;
+            // without the wrap quirk, whatever goes past the edges is clipped
+            if constexpr (Q::wrapSprites) {
+                pixelY &= display.height - 1;
+            } else {
+                if (pixelY >= display.height) break;
             }
+            uint16_t sprite_row = bits == 16
+                ? loadWord<Q>(addr + row * 2)
+                : load<Q>(addr + row);
+            if (display.drawRow<Q::wrapSprites>(plane, x_coord, pixelY, sprite_row, bits)) v_reg[0xF] = 1;
         }
+        addr += height * (bits / 8);
     }
     displayChanged = true;
 }
@@ -338,60 +398,348 @@ void Chip8::opcode_FX29(uint16_t& op) {
     }
 }
 
+// schip big font character, 10 bytes each
+void Chip8::opcode_FX30(uint16_t& op) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    i_reg = BIG_FONT_ADDR + (v_reg[x] & 0x0F) * 10;
+}
+
+// xo-chip long load, the address is the whole next word
+template <typename Q>
+void Chip8::opcode_F000() {
+    i_reg = loadWord<Q>(pc);
+    pc += 0x2;
+}
+
+void Chip8::opcode_FN01(uint16_t& op) {
+    display.selected = (op & 0x0F00) >> 8 & 0x3;
+}
+
+// xo-chip audio
+template <typename Q>
+void Chip8::opcode_F002() {
+    for (uint8_t i = 0; i < audioPattern.size(); i++) {
+        audioPattern[i] = load<Q>(i_reg + i);
+    }
+    emitAudio(AudioEvent::PATTERN);
+}
+
+void Chip8::opcode_FX3A(uint16_t& op) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    pitch = v_reg[x];
+    emitAudio(AudioEvent::PITCH);
+}
+
+// xo-chip register ranges, vx..vy in either direction. i stays put
+template <typename Q>
+void Chip8::opcode_5XY2(uint16_t& op) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    uint8_t y = (op & 0x00F0) >> 4;
+    int step = x <= y ? 1 : -1;
+    for (int i = 0; i <= abs(x - y); i++) {
+        store<Q>(i_reg + i, v_reg[x + i * step]);
+    }
+}
+
+template <typename Q>
+void Chip8::opcode_5XY3(uint16_t& op) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    uint8_t y = (op & 0x00F0) >> 4;
+    int step = x <= y ? 1 : -1;
+    for (int i = 0; i <= abs(x - y); i++) {
+        v_reg[x + i * step] = load<Q>(i_reg + i);
+    }
+}
+
+// schip rpl flags
+void Chip8::opcode_FX75(uint16_t& op) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    for (uint8_t i = 0; i <= x; i++) {
+        flags[i] = v_reg[i];
+    }
+}
+
+void Chip8::opcode_FX85(uint16_t& op) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    for (uint8_t i = 0; i <= x; i++) {
+        v_reg[i] = flags[i];
+    }
+}
+
+// schip scrolling, the display does the heavy lifting with word shifts / ring offsets
+void Chip8::opcode_00CN(uint16_t& op) {
+    display.scrollDown(op & 0x000F);
+    displayChanged = true;
+}
+
+void Chip8::opcode_00FB() {
+    display.scrollRight(4);
+    displayChanged = true;
+}
+
+void Chip8::opcode_00FC() {
+    display.scrollLeft(4);
+    displayChanged = true;
+}
+
+// xo-chip scroll up
+void Chip8::opcode_00DN(uint16_t& op) {
+    display.scrollUp(op & 0x000F);
+    displayChanged = true;
+}
+
+// exit, just spin on this instruction forever
+void Chip8::opcode_00FD() {
+    pc -= 0x2;
+}
+
+void Chip8::opcode_00FE() {
+    display.setHires(false);
+    displayChanged = true;
+}
+
+void Chip8::opcode_00FF() {
+    display.setHires(true);
+    displayChanged = true;
+}
+
 
+template <typename Q>
 void Chip8::exec(uint16_t op) {
-    uint16_t d1 = (op & 0xF000) >> 12;
-    uint16_t d2 = (op & 0x0F00) >> 8;
-    uint16_t d3 = (op & 0x00F0) >> 4;
-    uint16_t d4 = op & 0x000F;
-    switch (d1) {
-        case 0x0:
-            if (op == 0x00E0) { opcode_00E0(); }
-            if (op == 0x00EE) { opcode_00EE(); }
-        break;
-        case 0x1: opcode_1NNN(op); break;
-        case 0x2: opcode_2NNN(op); break;
-        case 0x3: opcode_3XNN(op); break;
-        case 0x4: opcode_4XNN(op); break;
-        case 0x5: opcode_5XY0(op); break;
-        case 0x6: opcode_6XNN(op); break;
-        case 0x7: opcode_7XNN(op); break;
-        case 0x8:
-            if (d4 == 0) { opcode_8XY0(op); }
-            if (d4 == 1) { opcode_8XY1(op); }
-            if (d4 == 2) { opcode_8XY2(op); }
-            if (d4 == 3) { opcode_8XY3(op); }
-            if (d4 == 4) { opcode_8XY4(op); }
-            if (d4 == 5) { opcode_8XY5(op); }
-            if (d4 == 6) { opcode_8XY6(op); }
-            if (d4 == 7) { opcode_8XY7(op); }
-            if (d4 == 0xE) { opcode_8XYE(op); }
-        break;
-        case 0x9: opcode_9XY0(op); break;
-        case 0xA: opcode_ANNN(op); break;
-        case 0xB: opcode_BNNN(op); break;
-        case 0xC: opcode_CXNN(op); break;
-        case 0xD: opcode_DXYN(op); break;
-        case 0xE:
-            if (d4 == 1) { opcode_EXA1(op); }
-            if (d4 == 0xE) { opcode_EX9E(op); }
-        break;
-        case 0xF:
-            switch (op & 0x00FF) {
-                case 0x07: opcode_FX07(op); break;
-                case 0x15: opcode_FX15(op); break;
-                case 0x18: opcode_FX18(op); break;
-                case 0x1E: opcode_FX1E(op); break;
-                case 0x29: opcode_FX29(op); break;
-                case 0X0A: opcode_FX0A(op); break;
-                case 0x65: opcode_FX65(op); break;
-                case 0x55: opcode_FX55(op); break;
-                case 0x33: opcode_FX33(op); break;
-                default: std::cout << "Unknown FX opcode: " << std::hex << op << std::endl; break;
-            }
-        break;
+    dispatch<Q>(decode(op, Q::superChip, Q::xoChip), op);
+}
+
+template <typename Q>
+void Chip8::dispatch(OpKind kind, uint16_t op) {
+    switch (kind) {
+        case OP_00E0: opcode_00E0(); break;
+        case OP_00EE: opcode_00EE(); break;
+        case OP_00CN: opcode_00CN(op); break;
+        case OP_00DN: opcode_00DN(op); break;
+        case OP_00FB: opcode_00FB(); break;
+        case OP_00FC: opcode_00FC(); break;
+        case OP_00FD: opcode_00FD(); break;
+        case OP_00FE: opcode_00FE(); break;
+        case OP_00FF: opcode_00FF(); break;
+        case OP_1NNN: opcode_1NNN(op); break;
+        case OP_2NNN: opcode_2NNN(op); break;
+        case OP_3XNN: opcode_3XNN<Q>(op); break;
+        case OP_4XNN: opcode_4XNN<Q>(op); break;
+        case OP_5XY0: opcode_5XY0<Q>(op); break;
+        case OP_5XY2: opcode_5XY2<Q>(op); break;
+        case OP_5XY3: opcode_5XY3<Q>(op); break;
+        case OP_6XNN: opcode_6XNN(op); break;
+        case OP_7XNN: opcode_7XNN(op); break;
+        case OP_8XY0: opcode_8XY0(op); break;
+        case OP_8XY1: opcode_8XY1<Q>(op); break;
+        case OP_8XY2: opcode_8XY2<Q>(op); break;
+        case OP_8XY3: opcode_8XY3<Q>(op); break;
+        case OP_8XY4: opcode_8XY4(op); break;
+        case OP_8XY5: opcode_8XY5(op); break;
+        case OP_8XY6: opcode_8XY6<Q>(op); break;
+        case OP_8XY7: opcode_8XY7(op); break;
+        case OP_8XYE: opcode_8XYE<Q>(op); break;
+        case OP_9XY0: opcode_9XY0<Q>(op); break;
+        case OP_ANNN: opcode_ANNN(op); break;
+        case OP_BNNN: opcode_BNNN<Q>(op); break;
+        case OP_CXNN: opcode_CXNN(op); break;
+        case OP_DXYN: opcode_DXYN<Q>(op); break;
+        case OP_EX9E: opcode_EX9E<Q>(op); break;
+        case OP_EXA1: opcode_EXA1<Q>(op); break;
+        case OP_F000: opcode_F000<Q>(); break;
+        case OP_FN01: opcode_FN01(op); break;
+        case OP_F002: opcode_F002<Q>(); break;
+        case OP_FX07: opcode_FX07(op); break;
+        case OP_FX0A: opcode_FX0A(op); break;
+        case OP_FX15: opcode_FX15(op); break;
+        case OP_FX18: opcode_FX18(op); break;
+        case OP_FX1E: opcode_FX1E(op); break;
+        case OP_FX29: opcode_FX29(op); break;
+        case OP_FX30: opcode_FX30(op); break;
+        case OP_FX33: opcode_FX33<Q>(op); break;
+        case OP_FX3A: opcode_FX3A(op); break;
+        case OP_FX55: opcode_FX55<Q>(op); break;
+        case OP_FX65: opcode_FX65<Q>(op); break;
+        case OP_FX75: opcode_FX75(op); break;
+        case OP_FX85: opcode_FX85(op); break;
+        case OP_NOP: break;
         default:
             std::cout << "Unknown opcode: " << std::hex << op << std::endl;
         break;
     }
 }
+
+// superinstructions, just the plain handlers back to back with the pc stepped in between
+// like run() would. returns how many instructions actually ran (a taken skip cuts the
+// delay loop short)
+template <typename Q>
+int Chip8::dispatchFused(OpKind kind, uint16_t op) {
+    uint16_t start = pc;
+    uint16_t op2 = loadWord<Q>(start + 2);
+    pc = start + 0x4;
+    switch (kind) {
+        case OP_ANNN_DXYN:
+            opcode_ANNN(op);
+            opcode_DXYN<Q>(op2);
+            return 2;
+        case OP_6XNN_6XNN:
+            opcode_6XNN(op);
+            opcode_6XNN(op2);
+            return 2;
+        case OP_7XNN_3XNN:
+            opcode_7XNN(op);
+            opcode_3XNN<Q>(op2);
+            return 2;
+        case OP_FX07_3XNN_1NNN: {
+            uint16_t op3 = loadWord<Q>(start + 4);
+            opcode_FX07(op);
+            opcode_3XNN<Q>(op2);
+            if (pc != start + 0x4) return 2;
+            pc = start + 0x6;
+            opcode_1NNN(op3);
+            return 3;
+        }
+        default:
+            pc = start;
+            return 0;
+    }
+}
+
+template <typename Q, bool PROFILE>
+void Chip8::run(int count) {
+    for (int i = 0; i < count; i++, cycles++) {
+        uint16_t op = loadWord<Q>(pc);
+        // pre-translated code skips the decode, anything else gets decoded on the fly
+        OpKind kind = translated[pc & Q::memoryMask];
+        if (kind >= OP_FUSED_FIRST) {
+            // only fuse when the whole sequence fits in this batch, so timing is unchanged
+            if (i + fusedLength(kind) <= count) {
+                uint16_t start = pc;
+                if constexpr (PROFILE) perf->begin();
+                int extra = dispatchFused<Q>(kind, op) - 1;
+                if constexpr (PROFILE) perf->end(kind);
+                i += extra;
+                cycles += extra;
+                fusionCounts[kind - OP_FUSED_FIRST]++;
+
+                // a delay loop that jumped back to itself will do exactly the same thing
+                // until the timer ticks, so burn the rest of the batch in one go
+                if (kind == OP_FX07_3XNN_1NNN && pc == start && dt != 0) {
+                    int loops = (count - i - 1) / 3;
+                    i += loops * 3;
+                    cycles += loops * 3;
+                    spinCyclesSkipped += loops * 3;
+                }
+                continue;
+            }
+            kind = OP_NONE;
+        }
+        if (kind == OP_NONE) kind = decode(op, Q::superChip, Q::xoChip);
+        if constexpr (PROFILE) perf->begin();
+        pc += 0x2;
+        dispatch<Q>(kind, op);
+        if constexpr (PROFILE) perf->end(kind);
+    }
+}
+
+template <typename Q, bool DEBUG>
+void Chip8::runTimed() {
+    while (cycleBudget > 0) {
+        uint16_t op = loadWord<Q>(pc);
+        // no fusion here, every instruction has to be charged on its own
+        OpKind kind = translated[pc & Q::memoryMask];
+        if (kind == OP_NONE || kind >= OP_FUSED_FIRST) kind = decode(op, Q::superChip, Q::xoChip);
+        if constexpr (DEBUG) {
+            if (debugger->check(kind, op)) {
+                cycleBudget = 0;
+                return;
+            }
+        }
+        pc += 0x2;
+        dispatch<Q>(kind, op);
+
+        int cost = vipCycles(kind, op);
+        cycles += cost;
+        cycleBudget -= cost;
+        // the vip draws in step with the display interrupt, so DXYN sits out the rest of the frame
+        if (kind == OP_DXYN && cycleBudget > 0) {
+            cycles += cycleBudget;
+            cycleBudget = 0;
+        }
+    }
+}
+
+template <typename Q>
+void Chip8::runDebug(int count) {
+    for (int i = 0; i < count; i++, cycles++) {
+        uint16_t op = loadWord<Q>(pc);
+        OpKind kind = translated[pc & Q::memoryMask];
+        if (kind == OP_NONE || kind >= OP_FUSED_FIRST) kind = decode(op, Q::superChip, Q::xoChip);
+        // stops before the instruction, it runs first thing when we're resumed
+        if (debugger->check(kind, op)) return;
+        pc += 0x2;
+        dispatch<Q>(kind, op);
+    }
+}
+
+template <typename Q>
+void Chip8::stepOne() {
+    uint16_t op = loadWord<Q>(pc);
+    OpKind kind = decode(op, Q::superChip, Q::xoChip);
+    pc += 0x2;
+    dispatch<Q>(kind, op);
+    cycles += clock.mode == ClockMode::VIP ? vipCycles(kind, op) : 1;
+}
+
+void Chip8::translate(const RomAnalysis& analysis) {
+    QuirkInfo info = quirkInfo(quirks);
+    for (size_t addr = 0; addr + 1 < MEMORY_SIZE; addr++) {
+        if (!(analysis.flags[addr] & ADDR_CODE)) continue;
+        uint16_t op = (ram[addr] << 8) | ram[addr + 1];
+        translated[addr] = decode(op, info.superChip, info.xoChip);
+    }
+
+    // now look for the sequences worth fusing. the plain entries for the 2nd/3rd
+    // instruction stay, so jumping into the middle of a sequence still works
+    for (size_t addr = 0; addr + 5 < MEMORY_SIZE; addr++) {
+        if (!(analysis.flags[addr] & ADDR_CODE)) continue;
+        OpKind first = translated[addr];
+        OpKind second = (analysis.flags[addr + 2] & ADDR_CODE) ? translated[addr + 2] : OP_NONE;
+        OpKind third = (analysis.flags[addr + 4] & ADDR_CODE) ? translated[addr + 4] : OP_NONE;
+
+        if (first == OP_ANNN && second == OP_DXYN) translated[addr] = OP_ANNN_DXYN;
+        if (first == OP_6XNN && second == OP_6XNN) translated[addr] = OP_6XNN_6XNN;
+        if (first == OP_7XNN && second == OP_3XNN) translated[addr] = OP_7XNN_3XNN;
+        if (first == OP_FX07 && second == OP_3XNN && third == OP_1NNN) translated[addr] = OP_FX07_3XNN_1NNN;
+    }
+}
+
+void Chip8::printFusionReport() const {
+    std::cout << "Superinstructions:" << std::endl;
+    for (size_t i = 0; i < fusionCounts.size(); i++) {
+        std::cout << "  " << std::left << std::setw(16) << opKindName((OpKind)(OP_FUSED_FIRST + i))
+                  << std::dec << fusionCounts[i] << std::endl;
+    }
+    std::cout << "  delay loop cycles skipped: " << std::dec << spinCyclesSkipped << std::endl;
+}
+
+template <typename Q>
+void Chip8::useCore() {
+    bool debugging = debugger && debugger->active();
+    execFn = &Chip8::exec<Q>;
+    stepFn = &Chip8::stepOne<Q>;
+    if (debugging) runFn = &Chip8::runDebug<Q>;
+    else if (perf) runFn = &Chip8::run<Q, true>;
+    else runFn = &Chip8::run<Q, false>;
+    timedFn = debugging ? &Chip8::runTimed<Q, true> : &Chip8::runTimed<Q, false>;
+}
+
+void Chip8::setQuirks(QuirkProfile profile) {
+    quirks = profile;
+    switch (profile) {
+        case QuirkProfile::VIP: useCore<QuirksVIP>(); break;
+        case QuirkProfile::CHIP48: useCore<QuirksCHIP48>(); break;
+        case QuirkProfile::SCHIP: useCore<QuirksSCHIP>(); break;
+        case QuirkProfile::XOCHIP: useCore<QuirksXOCHIP>(); break;
+    }
+}
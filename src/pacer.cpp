@@ -0,0 +1,79 @@
+#include "pacer.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+// bounds for the spin margin, in ns
+static constexpr int64_t MIN_SPIN = 200000;
+static constexpr int64_t MAX_SPIN = 3000000;
+
+FramePacer::FramePacer(int hz, int maxCatchUp) : hz(hz), maxCatchUp(maxCatchUp), origin(Clock::now()) {
+#ifdef _WIN32
+    // the default scheduler tick is 15.6 ms, which is most of a frame
+    timeBeginPeriod(1);
+#endif
+}
+
+FramePacer::~FramePacer() {
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+int FramePacer::framesDue() {
+    auto now = Clock::now();
+    int due = 0;
+    while (deadline(nextFrame) <= now) {
+        nextFrame++;
+        due++;
+    }
+    if (due > maxCatchUp) {
+        skippedFrames += due - maxCatchUp;
+        due = maxCatchUp;
+    }
+    if (due > 1) catchUpFrames += due - 1;
+    return due;
+}
+
+void FramePacer::wait() {
+    auto target = deadline(nextFrame);
+    auto now = Clock::now();
+    if (target <= now) {
+        // already late, don't sleep. the next framesDue() catches up
+        jitter.add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - target).count());
+        return;
+    }
+
+    auto sleepUntil = target - std::chrono::nanoseconds(spinMargin);
+    if (sleepUntil > now) {
+        std::this_thread::sleep_until(sleepUntil);
+        // adapt the margin: jump up to a bad oversleep right away, creep back down otherwise
+        int64_t overshoot = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sleepUntil).count();
+        int64_t wanted = overshoot + overshoot / 4;
+        spinMargin = wanted > spinMargin ? wanted : spinMargin - (spinMargin - wanted) / 16;
+        spinMargin = std::clamp(spinMargin, MIN_SPIN, MAX_SPIN);
+    }
+
+    while ((now = Clock::now()) < target) {
+        std::this_thread::yield();
+    }
+    jitter.add(std::chrono::duration_cast<std::chrono::nanoseconds>(now - target).count());
+}
+
+void FramePacer::printReport() const {
+    if (jitter.count == 0) return;
+    std::cout << "Frame pacing (" << hz << " Hz):" << std::endl;
+    std::cout << std::fixed << std::setprecision(1) << std::dec
+              << "  wake-up error us: mean " << jitter.total / 1000.0 / jitter.count
+              << "  p50 " << jitter.percentile(0.5) / 1000.0
+              << "  p99 " << jitter.percentile(0.99) / 1000.0
+              << "  max " << jitter.max / 1000.0 << std::endl;
+    std::cout << "  catch-up frames: " << catchUpFrames << ", dropped frames: " << skippedFrames
+              << ", spin margin: " << spinMargin / 1000.0 << " us" << std::endl;
+}
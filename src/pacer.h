@@ -0,0 +1,46 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "profiler.h"
+
+// keeps the frame loop at exactly `hz`. frame k is due at start + k * 1s / hz, computed
+// from the frame count in integer nanoseconds so nothing accumulates. waiting sleeps
+// most of the way and spins the last stretch, the spin margin follows how late the os
+// actually wakes us. when the loop falls behind it runs up to `maxCatchUp` frames in one
+// iteration, anything beyond that is dropped so a stall doesn't turn into fast forward
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit FramePacer(int hz = 60, int maxCatchUp = 4);
+    ~FramePacer();
+
+    // how many emulated frames are due now, at least 1 right after wait()
+    int framesDue();
+    // sleep + spin until the next frame is due
+    void wait();
+
+    void printReport() const;
+
+    // how far past the deadline wait() returned
+    Histogram jitter;
+    uint64_t catchUpFrames = 0;
+    uint64_t skippedFrames = 0;
+
+private:
+    int hz;
+    int maxCatchUp;
+    Clock::time_point origin;
+    uint64_t nextFrame = 0;
+    // how late sleep_for tends to come back, the spin covers this much
+    int64_t spinMargin = 1000000;
+
+    Clock::time_point deadline(uint64_t frame) const {
+        return origin + std::chrono::nanoseconds(frame * 1000000000ull / hz);
+    }
+};
+
+#endif // PACER_H
@@ -0,0 +1,204 @@
+#include "perf.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int openEvent(uint32_t type, uint64_t config, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group < 0;      // the leader starts the whole group
+    attr.exclude_kernel = 1;        // keeps the read() syscalls themselves out of the counts
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+} // namespace
+#endif
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+    for (void* page : pages) {
+        if (page) munmap(page, sysconf(_SC_PAGESIZE));
+    }
+    for (int fd : fds) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+}
+
+bool PerfCounters::open() {
+#ifdef __linux__
+    struct { uint32_t type; uint64_t config; } events[EVENTS] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                             | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    };
+
+    for (int e = 0; e < EVENTS; e++) {
+        int fd = openEvent(events[e].type, events[e].config, leader);
+        if (fd < 0) {
+            if (e == CYCLES) {
+                std::cerr << "perf_event_open failed: " << strerror(errno)
+                          << " (check /proc/sys/kernel/perf_event_paranoid)" << std::endl;
+                return false;
+            }
+            continue;
+        }
+        if (e == CYCLES) leader = fd;
+        fds[e] = fd;
+        slot[e] = opened++;
+    }
+
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+    // the kernel only says whether rdpmc works once the events are running
+    rdpmc = true;
+    for (int e = 0; e < EVENTS; e++) {
+        if (fds[e] < 0) continue;
+        void* page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fds[e], 0);
+        if (page == MAP_FAILED) {
+            rdpmc = false;
+            continue;
+        }
+        pages[e] = page;
+        if (!((perf_event_mmap_page*)page)->cap_user_rdpmc) rdpmc = false;
+    }
+    std::array<uint64_t, EVENTS> probe{};
+    if (rdpmc && !sampleUser(probe)) rdpmc = false;
+    calibrate();
+    return true;
+#else
+    std::cerr << "hardware counters are only supported on linux" << std::endl;
+    return false;
+#endif
+}
+
+bool PerfCounters::sample(std::array<uint64_t, EVENTS>& out) {
+#ifdef __linux__
+    if (rdpmc && sampleUser(out)) return true;
+    // PERF_FORMAT_GROUP: the member count, then one value per member
+    uint64_t buffer[1 + EVENTS];
+    ssize_t size = sizeof(uint64_t) * (1 + opened);
+    if (::read(leader, buffer, size) != size) return false;
+    for (int e = 0; e < EVENTS; e++) out[e] = slot[e] >= 0 ? buffer[1 + slot[e]] : 0;
+    return true;
+#else
+    (void)out;
+    return false;
+#endif
+}
+
+// the self-monitoring read from linux/perf_event.h: offset plus the live pmc value, retried
+// while the kernel updates the page. fails while an event isn't on a pmc (multiplexed out)
+bool PerfCounters::sampleUser(std::array<uint64_t, EVENTS>& out) const {
+#if defined(__linux__) && defined(__x86_64__)
+    std::array<uint64_t, EVENTS> values{};
+    for (int e = 0; e < EVENTS; e++) {
+        if (!pages[e]) continue;
+        volatile perf_event_mmap_page* page = (volatile perf_event_mmap_page*)pages[e];
+        uint32_t seq;
+        do {
+            seq = page->lock;
+            __asm__ volatile("" ::: "memory");
+            uint32_t index = page->index;
+            int64_t count = page->offset;
+            if (!page->cap_user_rdpmc || index == 0) return false;
+            uint32_t low, high;
+            __asm__ volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index - 1));
+            int shift = 64 - page->pmc_width;
+            count += (int64_t)(((uint64_t)high << 32 | low) << shift) >> shift;
+            values[e] = (uint64_t)count;
+            __asm__ volatile("" ::: "memory");
+        } while (page->lock != seq);
+    }
+    out = values;
+    return true;
+#else
+    (void)out;
+    return false;
+#endif
+}
+
+// cost of an empty begin/end pair, taken as the median so an interrupt doesn't skew it
+void PerfCounters::calibrate() {
+    const int runs = 1000;
+    std::array<std::vector<int64_t>, EVENTS> deltas;
+    for (int i = 0; i < runs; i++) {
+        std::array<uint64_t, EVENTS> a{}, b{};
+        if (!sample(a) || !sample(b)) continue;
+        for (int e = 0; e < EVENTS; e++) deltas[e].push_back((int64_t)(b[e] - a[e]));
+    }
+    for (int e = 0; e < EVENTS; e++) {
+        if (deltas[e].empty()) continue;
+        size_t middle = deltas[e].size() / 2;
+        std::nth_element(deltas[e].begin(), deltas[e].begin() + middle, deltas[e].end());
+        overhead[e] = deltas[e][middle];
+    }
+}
+
+void PerfCounters::printReport() const {
+    if (!available()) return;
+
+    int64_t totalCycles = 0;
+    for (const auto& kind : totals) totalCycles += std::max<int64_t>(kind[CYCLES], 0);
+
+    auto perOp = [](int64_t total, uint64_t count) { return std::max<int64_t>(total, 0) / (double)count; };
+    auto column = [&](int e, int64_t total, uint64_t count) {
+        std::cout << std::setw(10);
+        if (slot[e] < 0) std::cout << "-";
+        else std::cout << perOp(total, count);
+    };
+
+    std::cout << "Hardware counters per dispatch, read with " << (rdpmc ? "rdpmc" : "read()") << " ("
+              << overhead[CYCLES] << " cycles of read overhead removed):" << std::endl;
+    // the reads bracket single dispatches on purpose, batch totals can't be split per opcode
+    std::cout << "  every dispatch is read on its own rather than in batches, the reads still" << std::endl;
+    std::cout << "  disturb the predictors and l1d a little, compare kinds rather than absolutes" << std::endl;
+    std::cout << "  " << std::left << std::setw(16) << "opcode" << std::right << std::setw(12) << "count"
+              << std::setw(10) << "cycles" << std::setw(10) << "instrs" << std::setw(10) << "ipc"
+              << std::setw(10) << "br-miss" << std::setw(10) << "l1d-miss" << std::setw(10) << "cyc %" << std::endl;
+
+    // busiest first
+    std::vector<int> order;
+    for (int kind = 0; kind < OP_COUNT; kind++) {
+        if (counts[kind]) order.push_back(kind);
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return totals[a][CYCLES] > totals[b][CYCLES]; });
+
+    for (int kind : order) {
+        const auto& t = totals[kind];
+        uint64_t n = counts[kind];
+        double cycles = perOp(t[CYCLES], n);
+        double instrs = perOp(t[INSTRUCTIONS], n);
+        std::cout << "  " << std::left << std::setw(16) << opKindName((OpKind)kind) << std::right
+                  << std::setw(12) << n << std::fixed << std::setprecision(1) << std::setw(10) << cycles;
+        column(INSTRUCTIONS, t[INSTRUCTIONS], n);
+        std::cout << std::setw(10) << std::setprecision(2);
+        if (slot[INSTRUCTIONS] < 0 || cycles == 0) std::cout << "-";
+        else std::cout << instrs / cycles;
+        std::cout << std::setprecision(3);
+        column(BRANCH_MISSES, t[BRANCH_MISSES], n);
+        column(L1D_MISSES, t[L1D_MISSES], n);
+        std::cout << std::setprecision(1) << std::setw(10)
+                  << (totalCycles ? 100.0 * std::max<int64_t>(t[CYCLES], 0) / totalCycles : 0.0) << std::endl;
+    }
+}
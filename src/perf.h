@@ -0,0 +1,67 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <array>
+#include <cstdint>
+
+#include "decode.h"
+
+// hardware counters (cycles, instructions, branch misses, l1d read misses) read around
+// every dispatch of the normal core and attributed to its OpKind, fused superinstructions
+// as their own kinds. linux only, through perf_event_open, as an opt-in measuring mode
+// (--perf). reading around batches of instructions would disturb less but can't be split
+// per opcode: every instruction of a basic block runs exactly as often as the others, so
+// batch totals against per-kind counts never separate them. the counters are read with
+// rdpmc through the mmap'd event pages when the kernel allows it (x86-64, no kernel entry),
+// with a read() of the group otherwise. the cost of an empty begin/end pair is measured up
+// front and subtracted
+class PerfCounters {
+public:
+    enum Event { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, EVENTS };
+
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // false (with the reason on stderr) when the kernel won't give us counters, e.g. not
+    // linux, perf_event_paranoid too high, or a vm without a pmu. events the cpu doesn't
+    // have are left out, only cycles is required
+    bool open();
+    bool available() const { return leader >= 0; }
+
+    void begin() { started = sample(start); }
+    void end(OpKind kind) {
+        // a failed read on either side leaves nothing to subtract, drop the sample
+        std::array<uint64_t, EVENTS> now{};
+        if (!started || !sample(now)) return;
+        for (int e = 0; e < EVENTS; e++) totals[kind][e] += (int64_t)(now[e] - start[e]) - overhead[e];
+        counts[kind]++;
+    }
+
+    void printReport() const;
+
+private:
+    int leader = -1;
+    std::array<int, EVENTS> fds{-1, -1, -1, -1};
+    // position of each event in the group read, -1 if it couldn't be opened
+    std::array<int, EVENTS> slot{-1, -1, -1, -1};
+    int opened = 0;
+    // the mmap'd perf_event_mmap_page of each event, rdpmc is only used if all of them allow it
+    std::array<void*, EVENTS> pages{};
+    bool rdpmc = false;
+
+    std::array<uint64_t, EVENTS> start{};
+    bool started = false;
+    std::array<int64_t, EVENTS> overhead{};
+    std::array<std::array<int64_t, EVENTS>, OP_COUNT> totals{};
+    std::array<uint64_t, OP_COUNT> counts{};
+
+    // false when the counters couldn't be read, out is left alone then
+    bool sample(std::array<uint64_t, EVENTS>& out);
+    bool sampleUser(std::array<uint64_t, EVENTS>& out) const;
+
+    void calibrate();
+};
+
+#endif // PERF_H
@@ -0,0 +1,115 @@
+#include "profiler.h"
+#include <bit>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+
+const char* zoneName(ProfileZone zone) {
+    switch (zone) {
+        case ZONE_FRAME: return "frame";
+        case ZONE_INPUT: return "input";
+        case ZONE_EMULATE: return "emulate";
+        case ZONE_RENDER: return "render";
+        case ZONE_DEBUG_INFO: return "renderDebugInfo";
+        case ZONE_DEBUG_WINDOW: return "renderDebugWindow";
+        case ZONE_SLEEP: return "sleep";
+        default: return "?";
+    }
+}
+
+// values below 8 get a bucket each, above that the exponent picks a group of 8 and the
+// next 3 bits below the top one pick the bucket inside it
+size_t Histogram::bucketOf(uint64_t ns) {
+    if (ns < (1 << SUB_BITS)) return ns;
+    int exponent = 63 - std::countl_zero(ns);
+    size_t sub = (ns >> (exponent - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+    return (size_t)(exponent - SUB_BITS + 1) * (1 << SUB_BITS) + sub;
+}
+
+uint64_t Histogram::bucketMiddle(size_t index) {
+    if (index < (1 << SUB_BITS)) return index;
+    int exponent = (int)(index >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t sub = index & ((1 << SUB_BITS) - 1);
+    uint64_t low = ((1ull << SUB_BITS) + sub) << (exponent - SUB_BITS);
+    return low + (1ull << (exponent - SUB_BITS)) / 2;
+}
+
+void Histogram::add(uint64_t ns) {
+    buckets[bucketOf(ns)]++;
+    count++;
+    total += ns;
+    if (ns > max) max = ns;
+}
+
+uint64_t Histogram::percentile(double p) const {
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(p * count);
+    if (rank >= count) rank = count - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen > rank) return std::min(bucketMiddle(i), max);
+    }
+    return max;
+}
+
+void Profiler::end(ProfileZone zone) {
+    auto now = Clock::now();
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - started[zone]).count();
+    histograms[zone].add(ns);
+    last[zone] = ns;
+
+    if (tracing) {
+        if (trace.size() >= maxTraceEvents) {
+            tracing = false;
+            return;
+        }
+        uint64_t start = std::chrono::duration_cast<std::chrono::nanoseconds>(started[zone] - epoch).count();
+        trace.push_back({zone, start, ns});
+    }
+}
+
+void Profiler::startTrace(size_t maxEvents) {
+    maxTraceEvents = maxEvents;
+    trace.reserve(std::min<size_t>(maxEvents, 1 << 16));
+    tracing = true;
+}
+
+bool Profiler::writeTrace(const std::string& filename) const {
+    FILE* file = fopen(filename.c_str(), "w");
+    if (!file) {
+        std::cerr << "Error: Failed to open " << filename << std::endl;
+        return false;
+    }
+    // chrome trace event format, complete ("X") events in microseconds. the frame zone
+    // goes on its own row so the parts of a frame stack under it
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < trace.size(); i++) {
+        const TraceEvent& event = trace[i];
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                zoneName(event.zone), event.zone == ZONE_FRAME ? 1 : 2,
+                event.start / 1000.0, event.duration / 1000.0, i + 1 < trace.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+    std::cout << "Wrote " << trace.size() << " trace events to " << filename << std::endl;
+    return true;
+}
+
+void Profiler::printReport() const {
+    std::cout << "Frame timing (us):" << std::endl;
+    std::cout << "  " << std::left << std::setw(18) << "zone" << std::right
+              << std::setw(10) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50"
+              << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+    for (size_t zone = 0; zone < ZONE_COUNT; zone++) {
+        const Histogram& h = histograms[zone];
+        if (h.count == 0) continue;
+        std::cout << "  " << std::left << std::setw(18) << zoneName((ProfileZone)zone) << std::right << std::fixed
+                  << std::setprecision(1) << std::dec
+                  << std::setw(10) << h.count
+                  << std::setw(10) << h.total / 1000.0 / h.count
+                  << std::setw(10) << h.percentile(0.5) / 1000.0
+                  << std::setw(10) << h.percentile(0.99) / 1000.0
+                  << std::setw(10) << h.max / 1000.0 << std::endl;
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// timing zones around each part of the frame loop. every zone feeds a latency histogram
+// (for p50/p99/max at exit and the F3 overlay), and with --trace every begin/end pair is
+// also kept as an event for chrome://tracing / perfetto
+enum ProfileZone : uint8_t {
+    ZONE_FRAME,         // one whole loop iteration, sleep included
+    ZONE_INPUT,
+    ZONE_EMULATE,
+    ZONE_RENDER,
+    ZONE_DEBUG_INFO,
+    ZONE_DEBUG_WINDOW,
+    ZONE_SLEEP,
+    ZONE_COUNT
+};
+
+const char* zoneName(ProfileZone zone);
+
+// log-linear buckets, 8 per power of two, so any percentile is within ~12% of the truth
+// at a fixed 2k of memory
+class Histogram {
+public:
+    void add(uint64_t ns);
+    uint64_t percentile(double p) const;
+
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t max = 0;
+
+private:
+    static constexpr int SUB_BITS = 3;
+    std::array<uint32_t, 512> buckets{};
+
+    static size_t bucketOf(uint64_t ns);
+    static uint64_t bucketMiddle(size_t index);
+};
+
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct TraceEvent {
+        ProfileZone zone;
+        uint64_t start;     // ns since the profiler was created
+        uint64_t duration;
+    };
+
+    // times one zone for as long as it's in scope
+    class Scope {
+    public:
+        Scope(Profiler& profiler, ProfileZone zone) : profiler(profiler), zone(zone) { profiler.begin(zone); }
+        ~Scope() { profiler.end(zone); }
+    private:
+        Profiler& profiler;
+        ProfileZone zone;
+    };
+
+    Profiler() : epoch(Clock::now()) {}
+
+    void begin(ProfileZone zone) { started[zone] = Clock::now(); }
+    void end(ProfileZone zone);
+
+    // keep every zone as a trace event, up to `maxEvents` (then tracing just stops)
+    void startTrace(size_t maxEvents = 1 << 20);
+    bool writeTrace(const std::string& filename) const;
+    void printReport() const;
+
+    std::array<Histogram, ZONE_COUNT> histograms;
+    // most recent duration of each zone in ns, for the overlay
+    std::array<uint64_t, ZONE_COUNT> last{};
+
+private:
+    Clock::time_point epoch;
+    std::array<Clock::time_point, ZONE_COUNT> started{};
+    bool tracing = false;
+    size_t maxTraceEvents = 0;
+    std::vector<TraceEvent> trace;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,46 @@
+#include "quirks.h"
+#include <algorithm>
+#include <cctype>
+
+std::optional<QuirkProfile> parseQuirkProfile(const std::string& name) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if (lower == "vip" || lower == "cosmac") return QuirkProfile::VIP;
+    if (lower == "chip48" || lower == "chip-48") return QuirkProfile::CHIP48;
+    if (lower == "schip" || lower == "superchip") return QuirkProfile::SCHIP;
+    if (lower == "xochip" || lower == "xo-chip") return QuirkProfile::XOCHIP;
+    return std::nullopt;
+}
+
+QuirkProfile detectQuirkProfile(const std::string& filename) {
+    auto dot = filename.find_last_of('.');
+    if (dot == std::string::npos) return QuirkProfile::VIP;
+
+    std::string ext = filename.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if (ext == "sc8" || ext == "sc") return QuirkProfile::SCHIP;
+    if (ext == "xo8") return QuirkProfile::XOCHIP;
+    return QuirkProfile::VIP;
+}
+
+const char* quirkProfileName(QuirkProfile profile) {
+    switch (profile) {
+        case QuirkProfile::VIP: return "COSMAC VIP";
+        case QuirkProfile::CHIP48: return "CHIP-48";
+        case QuirkProfile::SCHIP: return "SUPER-CHIP";
+        case QuirkProfile::XOCHIP: return "XO-CHIP";
+    }
+    return "unknown";
+}
+
+QuirkInfo quirkInfo(QuirkProfile profile) {
+    switch (profile) {
+        case QuirkProfile::VIP: return {QuirksVIP::superChip, QuirksVIP::xoChip, QuirksVIP::memoryMask};
+        case QuirkProfile::CHIP48: return {QuirksCHIP48::superChip, QuirksCHIP48::xoChip, QuirksCHIP48::memoryMask};
+        case QuirkProfile::SCHIP: return {QuirksSCHIP::superChip, QuirksSCHIP::xoChip, QuirksSCHIP::memoryMask};
+        case QuirkProfile::XOCHIP: return {QuirksXOCHIP::superChip, QuirksXOCHIP::xoChip, QuirksXOCHIP::memoryMask};
+    }
+    return {false, false, 0xFFF};
+}
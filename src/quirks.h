@@ -0,0 +1,76 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include <cstdint>
+#include <string>
+#include <optional>
+
+// the different chip8 flavours disagree on a handful of opcodes. each profile is a
+// policy type that gets passed to the interpreter as a template parameter, so every
+// quirk check is resolved at compile time and the chosen core has no quirk branches
+enum class QuirkProfile {
+    VIP,
+    CHIP48,
+    SCHIP,
+    XOCHIP
+};
+
+struct QuirksVIP {
+    static constexpr bool vfReset = true;          // 8XY1/2/3 reset vf
+    static constexpr bool memoryIncrement = true;  // FX55/FX65 leave i pointing after the last register
+    static constexpr bool shiftVY = true;          // 8XY6/8XYE shift vy into vx instead of vx in place
+    static constexpr bool wrapSprites = false;     // DXYN wraps sprites around the edges instead of clipping
+    static constexpr bool jumpVX = false;          // BXNN jumps to XNN + vx instead of NNN + v0
+    static constexpr bool superChip = false;       // 00CN/00FB/00FC/00FE/00FF, DXY0, FX30, FX75/FX85
+    static constexpr bool xoChip = false;          // F000 NNNN, 5XY2/5XY3, FN01 planes, 00DN, F002/FX3A audio
+    static constexpr uint16_t memoryMask = 0xFFF;  // ram addresses wrap at 4k, or 64k on xo-chip
+};
+
+struct QuirksCHIP48 {
+    static constexpr bool vfReset = false;
+    static constexpr bool memoryIncrement = false;
+    static constexpr bool shiftVY = false;
+    static constexpr bool wrapSprites = false;
+    static constexpr bool jumpVX = true;
+    static constexpr bool superChip = false;
+    static constexpr bool xoChip = false;
+    static constexpr uint16_t memoryMask = 0xFFF;
+};
+
+struct QuirksSCHIP {
+    static constexpr bool vfReset = false;
+    static constexpr bool memoryIncrement = false;
+    static constexpr bool shiftVY = false;
+    static constexpr bool wrapSprites = false;
+    static constexpr bool jumpVX = true;
+    static constexpr bool superChip = true;
+    static constexpr bool xoChip = false;
+    static constexpr uint16_t memoryMask = 0xFFF;
+};
+
+struct QuirksXOCHIP {
+    static constexpr bool vfReset = false;
+    static constexpr bool memoryIncrement = true;
+    static constexpr bool shiftVY = true;
+    static constexpr bool wrapSprites = true;
+    static constexpr bool jumpVX = false;
+    static constexpr bool superChip = true;
+    static constexpr bool xoChip = true;
+    static constexpr uint16_t memoryMask = 0xFFFF;
+};
+
+// the opcode set flags of a profile, for code that only knows the profile at runtime
+struct QuirkInfo {
+    bool superChip;
+    bool xoChip;
+    uint16_t memoryMask;
+};
+QuirkInfo quirkInfo(QuirkProfile profile);
+
+// "vip", "chip48", "schip" or "xochip"
+std::optional<QuirkProfile> parseQuirkProfile(const std::string& name);
+// guess from the rom extension (.sc8 -> schip, .xo8 -> xochip, anything else -> vip)
+QuirkProfile detectQuirkProfile(const std::string& filename);
+const char* quirkProfileName(QuirkProfile profile);
+
+#endif // QUIRKS_H
@@ -0,0 +1,119 @@
+#include "scaler.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+// rgba8888, alpha in the low byte stays as it is
+static uint32_t half(uint32_t color) { return ((color >> 1) & 0x7F7F7F00) | (color & 0xFF); }
+
+bool Scaler::parseFilter(const std::string& name, Filter& filter) {
+    if (name == "none") filter = Filter::NONE;
+    else if (name == "scanlines") filter = Filter::SCANLINES;
+    else if (name == "grid") filter = Filter::GRID;
+    else return false;
+    return true;
+}
+
+int Scaler::fitScale(int outputWidth, int outputHeight, size_t width, size_t height) {
+    return std::max(1, std::min(outputWidth / (int)width, outputHeight / (int)height));
+}
+
+void Scaler::build(SDL_Renderer* renderer, const Display& display, int newScale) {
+    scale = newScale;
+    width = display.width;
+    height = display.height;
+    builtFilter = filter;
+
+    if (texture) SDL_DestroyTexture(texture);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                width * scale, height * scale);
+
+    // how many of the cell's lines (and for the grid, columns) are dimmed. at scale 1 there
+    // is no room for any of it
+    int dimmed = 0;
+    if (scale > 1 && filter == Filter::SCANLINES) dimmed = std::max(1, scale / 3);
+    if (scale > 1 && filter == Filter::GRID) dimmed = std::max(1, scale / 10);
+
+    dimLines.assign(scale, false);
+    for (int line = scale - dimmed; line < scale; line++) dimLines[line] = true;
+
+    cells.resize(2 * CELL_COLORS * scale);
+    for (int color = 0; color < CELL_COLORS; color++) {
+        uint32_t rgba = color < 4 ? Display::PALETTE[color] : half(half(Display::PALETTE[color - 4]));
+        uint32_t* bright = &cells[color * scale];
+        uint32_t* dim = &cells[(CELL_COLORS + color) * scale];
+        for (int x = 0; x < scale; x++) {
+            bool edge = filter == Filter::GRID && x >= scale - dimmed;
+            bright[x] = edge ? half(rgba) : rgba;
+            dim[x] = half(rgba);
+        }
+    }
+
+    brightLine.resize(width * scale);
+    dimLine.resize(width * scale);
+
+    // everything is redrawn from scratch, nothing to fade
+    for (size_t p = 0; p < Display::PLANES; p++) {
+        for (size_t y = 0; y < height; y++) previous[p][y] = display.row(y, p);
+    }
+    fadingRows = 0;
+}
+
+void Scaler::expandRow(const Display& display, size_t y, uint32_t* out, size_t pitch) {
+    Display::Row plane0 = display.row(y, 0);
+    Display::Row plane1 = display.row(y, 1);
+    Display::Row ghost0 = 0;
+    Display::Row ghost1 = 0;
+    if (phosphor) {
+        Display::Row lit = plane0 | plane1;
+        ghost0 = previous[0][y] & ~lit;
+        ghost1 = previous[1][y] & ~lit;
+        previous[0][y] = plane0;
+        previous[1][y] = plane1;
+        uint64_t bit = uint64_t(1) << y;
+        fadingRows = (ghost0 | ghost1) ? (fadingRows | bit) : (fadingRows & ~bit);
+    }
+
+    const size_t cellBytes = scale * sizeof(uint32_t);
+    for (size_t x = 0; x < width; x++) {
+        int shift = Display::MAX_WIDTH - 1 - x;
+        int color = ((plane0 >> shift) & 1) | (((plane1 >> shift) & 1) << 1);
+        int ghost = ((ghost0 >> shift) & 1) | (((ghost1 >> shift) & 1) << 1);
+        if (ghost) color = 4 | ghost;
+        memcpy(&brightLine[x * scale], &cells[color * scale], cellBytes);
+        memcpy(&dimLine[x * scale], &cells[(CELL_COLORS + color) * scale], cellBytes);
+    }
+
+    const size_t lineBytes = width * cellBytes;
+    for (int line = 0; line < scale; line++) {
+        memcpy(out + line * pitch, dimLines[line] ? dimLine.data() : brightLine.data(), lineBytes);
+    }
+}
+
+void Scaler::update(SDL_Renderer* renderer, const Display& display, uint64_t dirtyRows, int newScale) {
+    if (!texture || newScale != scale || display.width != width || display.height != height || filter != builtFilter) {
+        build(renderer, display, newScale);
+        dirtyRows = ~uint64_t(0);
+    }
+    if (!texture) return;
+
+    uint64_t rows = dirtyRows | fadingRows;
+    if (height < 64) rows &= (uint64_t(1) << height) - 1;
+
+    // one lock per run of changed rows, each run is rewritten completely
+    while (rows) {
+        size_t first = std::countr_zero(rows);
+        size_t end = first + std::countr_one(rows >> first);
+        rows &= end == 64 ? 0 : ~uint64_t(0) << end;
+
+        SDL_Rect rect = {0, (int)(first * scale), (int)(width * scale), (int)((end - first) * scale)};
+        void* pixels;
+        int pitch;
+        if (SDL_LockTexture(texture, &rect, &pixels, &pitch) != 0) return;
+        size_t linePitch = pitch / sizeof(uint32_t);
+        for (size_t y = first; y < end; y++) {
+            expandRow(display, y, (uint32_t*)pixels + (y - first) * scale * linePitch, linePitch);
+        }
+        SDL_UnlockTexture(texture);
+    }
+}
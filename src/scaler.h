@@ -0,0 +1,78 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <SDL2/SDL.h>
+
+#include "display.h"
+
+// cpu side upscaling of the main window for the filters the gpu's nearest neighbour copy
+// can't do. every source pixel turns into a scale x scale cell built from precomputed
+// templates: one cell row per palette color in a bright and a dim version, and a list
+// saying which of the two each of the cell's scale lines uses. a changed source row is
+// expanded once into a bright and a dim output line and the cell lines are plain copies of
+// those, so the cost follows the changed rows of the packed image, not the window size.
+// rows the core didn't touch stay in the texture as they are
+class Scaler {
+public:
+    enum class Filter {
+        NONE,
+        // the bottom third of every cell at half brightness
+        SCANLINES,
+        // a dark line along the right and bottom edge of every cell
+        GRID,
+    };
+
+    Filter filter = Filter::NONE;
+    // pixels switched off since the last presented frame stay at a quarter of their color
+    // for one more frame, which hides most of the xor flicker of erase/redraw loops
+    bool phosphor = false;
+    // set while ghosts are on screen, the next frame has to be drawn even if the core
+    // didn't change anything to fade them out
+    bool fading() const { return fadingRows != 0; }
+
+    static bool parseFilter(const std::string& name, Filter& filter);
+
+    // the largest integer multiple of width x height that fits the output, at least 1
+    static int fitScale(int outputWidth, int outputHeight, size_t width, size_t height);
+
+    // without a filter the gpu does the scaling and none of this is needed
+    bool active() const { return filter != Filter::NONE || phosphor; }
+
+    // expands the rows in `dirtyRows` (plus the ones with fading ghosts) into the texture.
+    // a new scale or resolution rebuilds the templates and the texture and redraws it all
+    void update(SDL_Renderer* renderer, const Display& display, uint64_t dirtyRows, int scale);
+    // one source row as scale output lines, `pitch` in pixels. exposed for update() and
+    // for anything that wants the filtered image without a texture
+    void expandRow(const Display& display, size_t y, uint32_t* out, size_t pitch);
+
+    // owned, destroyed with the renderer in cleanupSDL
+    SDL_Texture* texture = nullptr;
+
+private:
+    static constexpr int CELL_COLORS = 8;
+
+    int scale = 0;
+    size_t width = 0;
+    size_t height = 0;
+    Filter builtFilter = Filter::NONE;
+
+    // CELL_COLORS bright cells then CELL_COLORS dim cells, scale pixels each. colors 0-3 are
+    // the palette, 4-7 the ghosts of the same palette entries
+    std::vector<uint32_t> cells;
+    // per cell line, true when it uses the dim version
+    std::vector<bool> dimLines;
+    std::vector<uint32_t> brightLine;
+    std::vector<uint32_t> dimLine;
+
+    // what each row showed when it was last drawn, per plane, for the ghosts
+    std::array<std::array<Display::Row, Display::MAX_HEIGHT>, Display::PLANES> previous{};
+    uint64_t fadingRows = 0;
+
+    void build(SDL_Renderer* renderer, const Display& display, int scale);
+};
+
+#endif // SCALER_H
@@ -6,40 +6,190 @@
 #include "../include/miniaudio.h"
 #include <cmath>
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "audio_events.h"
 
 #define SAMPLE_RATE 44100
 #define FREQUENCY 440.0
 #define AMPLITUDE 0.5
+// attack/release ramp so the beeper doesn't click when it switches
+#define RAMP_MS 5.0
 
-struct SoundData {
-    double phase;
-    bool isPlaying;
-};
+// the beeper synth, kept apart from the device so it can be benchmarked. the core sends
+// it timestamped events through a lock-free ring, and the callback places each one at
+// the sample matching its emulated cycle, so beep lengths don't depend on host
+// scheduling. a sample costs one table lookup: the phase is a 32 bit fixed point
+// accumulator whose top bits index a sine table
+struct Synth {
+    static constexpr int TABLE_BITS = 8;
+    static constexpr int TABLE_SIZE = 1 << TABLE_BITS;
 
-class Sound {
-public:
-    ma_device device;
-    SoundData soundData = {0, false};
+    AudioEventQueue events;
 
-    static void data_callback(ma_device* device, void* output, const void* input, ma_uint32 frameCount) {
-        SoundData* data = (SoundData*)device->pUserData;
-        float* out = (float*)output;
+    double sampleRate;
+    std::array<float, TABLE_SIZE> sineTable;
+    uint32_t phase = 0;
+    uint32_t phaseStep;
+    float envelope = 0.0f;
+    float rampStep;
+    bool gate = false;
 
-        for (ma_uint32 i = 0; i < frameCount; i++) {
-            float sample = data->isPlaying ? AMPLITUDE * sin(2.0 * M_PI * FREQUENCY * data->phase / SAMPLE_RATE) : 0.0f;
+    // xo-chip sample loop, 128 1-bit samples. the top 7 bits of patternPhase pick the bit
+    uint64_t pattern[2] = {0, 0};
+    bool hasPattern = false;
+    uint32_t patternStep = 0;
+    uint32_t patternPhase = 0;
+
+    // emulated time -> sample position. bufferCycle is the emulated cycle that lines up
+    // with the start of the next buffer, kept `latency` cycles behind the newest events
+    double samplesPerCycle;
+    double bufferCycle = 0;
+    double latency;
+    double maxDrift;
+    bool synced = false;
+
+    explicit Synth(double cyclesPerSecond, double sampleRate = SAMPLE_RATE) : sampleRate(sampleRate) {
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            sineTable[i] = (float)(AMPLITUDE * sin(2.0 * M_PI * i / TABLE_SIZE));
+        }
+        phaseStep = (uint32_t)(FREQUENCY / sampleRate * 4294967296.0);
+        rampStep = (float)(1.0 / (sampleRate * RAMP_MS / 1000.0));
+        setPitch(64);
+        samplesPerCycle = sampleRate / cyclesPerSecond;
+        latency = cyclesPerSecond / 30;     // two frames
+        maxDrift = cyclesPerSecond / 4;
+    }
+
+    // pitch 64 is 4000 bits per second and every 48 steps is an octave
+    void setPitch(uint8_t pitch) {
+        double rate = 4000.0 * pow(2.0, (pitch - 64) / 48.0);
+        patternStep = (uint32_t)(rate / sampleRate * (1u << 25));
+    }
+
+    void setPattern(const std::array<uint8_t, 16>& bytes) {
+        for (int half = 0; half < 2; half++) {
+            pattern[half] = 0;
+            for (int i = 0; i < 8; i++) pattern[half] = (pattern[half] << 8) | bytes[half * 8 + i];
+        }
+        hasPattern = true;
+    }
+
+    void apply(const AudioEvent& event) {
+        switch (event.type) {
+            case AudioEvent::GATE_ON: gate = true; break;
+            case AudioEvent::GATE_OFF: gate = false; break;
+            case AudioEvent::PITCH: setPitch(event.pitch); break;
+            case AudioEvent::PATTERN: setPattern(event.pattern); break;
+        }
+    }
+
+    // interleaved stereo floats
+    void render(float* out, uint32_t frameCount) {
+        double endCycle = bufferCycle + frameCount / samplesPerCycle;
+        uint32_t pos = 0;
+
+        while (const AudioEvent* event = events.peek()) {
+            double at = (double)event->cycle;
+            // first event, or the clocks drifted apart (pause, host hiccup): line the
+            // event up `latency` cycles ahead of the audio clock again
+            if (!synced || at < bufferCycle - maxDrift || at > endCycle + maxDrift) {
+                bufferCycle = at - latency;
+                endCycle = bufferCycle + frameCount / samplesPerCycle;
+                synced = true;
+            }
+            if (at >= endCycle) break;
+
+            uint32_t offset = at <= bufferCycle ? 0 : (uint32_t)((at - bufferCycle) * samplesPerCycle);
+            offset = std::min(offset, frameCount);
+            if (offset > pos) {
+                renderSpan(out + pos * 2, offset - pos);
+                pos = offset;
+            }
+            apply(*event);
+            events.pop();
+        }
+
+        renderSpan(out + pos * 2, frameCount - pos);
+        bufferCycle = endCycle;
+    }
+
+    void renderSpan(float* out, uint32_t frameCount) {
+        float target = gate ? 1.0f : 0.0f;
+
+        // silent and settled, nothing to compute
+        if (target == 0.0f && envelope == 0.0f) {
+            std::fill(out, out + frameCount * 2, 0.0f);
+            return;
+        }
+
+        if (hasPattern) {
+            for (uint32_t i = 0; i < frameCount; i++) {
+                uint32_t bit = patternPhase >> 25;
+                float level = (pattern[bit >> 6] >> (63 - (bit & 63))) & 1 ? AMPLITUDE : -AMPLITUDE;
+                float sample = level * nextEnvelope(target);
+                *out++ = sample;
+                *out++ = sample;
+                patternPhase += patternStep;
+            }
+            return;
+        }
+
+        for (uint32_t i = 0; i < frameCount; i++) {
+            float sample = sineTable[phase >> (32 - TABLE_BITS)] * nextEnvelope(target);
             *out++ = sample;
             *out++ = sample;
-            data->phase += 1.0;
-            if (data->phase >= SAMPLE_RATE) data->phase -= SAMPLE_RATE;
+            phase += phaseStep;
         }
     }
 
-    Sound() {
+    float nextEnvelope(float target) {
+        if (envelope < target) envelope = std::min(target, envelope + rampStep);
+        else if (envelope > target) envelope = std::max(target, envelope - rampStep);
+        return envelope;
+    }
+};
+
+// where the synth output goes. the core only ever sees the event queue, so it doesn't
+// care whether a sound card or a file is listening
+class AudioSink {
+public:
+    Synth synth;
+
+    AudioSink(double cyclesPerSecond, double sampleRate) : synth(cyclesPerSecond, sampleRate) {}
+    virtual ~AudioSink() = default;
+
+    // the core pushes into this, see Chip8::audioOut
+    AudioEventQueue* events() { return &synth.events; }
+
+    // called after each emulated frame with the current cycle count. a device pulls
+    // samples on its own clock and ignores this, offline sinks render up to `cycle`
+    virtual void flush(uint64_t cycle) {}
+};
+
+// real time playback through miniaudio
+class Sound : public AudioSink {
+public:
+    ma_device device;
+
+    static void data_callback(ma_device* device, void* output, const void* input, ma_uint32 frameCount) {
+        Synth* synth = (Synth*)device->pUserData;
+        synth->render((float*)output, frameCount);
+    }
+
+    explicit Sound(double cyclesPerSecond) : AudioSink(cyclesPerSecond, SAMPLE_RATE) {
         ma_device_config config = ma_device_config_init(ma_device_type_playback);
         config.playback.format = ma_format_f32;
         config.playback.channels = 2;
         config.sampleRate = SAMPLE_RATE;
-        config.pUserData = &soundData;
+        config.pUserData = &synth;
         config.dataCallback = data_callback;
 
         if (ma_device_init(NULL, &config, &device) != MA_SUCCESS) {
@@ -52,8 +202,120 @@ public:
         ma_device_uninit(&device);
     }
 
-    void play(bool enable) {
-        soundData.isPlaying = enable;
+    // --bench-audio: time the callback per buffer, against the old per-sample sin()
+    static void benchmark(uint32_t frameCount = 512, int buffers = 20000) {
+        using namespace std::chrono;
+        std::vector<float> out(frameCount * 2);
+        Synth synth(600);
+
+        auto time = [&](const char* name, auto&& callback) {
+            auto start = high_resolution_clock::now();
+            for (int i = 0; i < buffers; i++) callback();
+            double ns = duration<double, std::nano>(high_resolution_clock::now() - start).count() / buffers;
+            std::cout << "  " << name << ": " << ns << " ns per " << frameCount << " frame buffer ("
+                      << ns / frameCount << " ns/sample)" << std::endl;
+        };
+
+        std::cout << "Audio callback benchmark" << std::endl;
+        double refPhase = 0;
+        time("sin() reference", [&] {
+            float* o = out.data();
+            for (uint32_t i = 0; i < frameCount; i++) {
+                float sample = AMPLITUDE * sin(2.0 * M_PI * FREQUENCY * refPhase / SAMPLE_RATE);
+                *o++ = sample;
+                *o++ = sample;
+                refPhase += 1.0;
+                if (refPhase >= SAMPLE_RATE) refPhase -= SAMPLE_RATE;
+            }
+        });
+        time("wavetable, gate off", [&] { synth.render(out.data(), frameCount); });
+        synth.gate = true;
+        time("wavetable, gate on", [&] { synth.render(out.data(), frameCount); });
+        synth.setPattern({0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00});
+        time("xo-chip pattern", [&] { synth.render(out.data(), frameCount); });
+
+        // a beep edge every buffer, going through the event ring
+        synth.hasPattern = false;
+        uint64_t cycle = 0;
+        time("wavetable, with events", [&] {
+            synth.events.push({cycle, cycle % 2 ? AudioEvent::GATE_OFF : AudioEvent::GATE_ON, 64, {}});
+            cycle += 7;
+            synth.render(out.data(), frameCount);
+        });
+    }
+};
+
+// renders into a 16 bit stereo wav file as fast as the core runs, for headless runs.
+// the output only depends on the rom and the frame count, so ci can hash it
+class WavSink : public AudioSink {
+public:
+    std::ofstream file;
+    std::vector<float> buffer;
+    std::vector<char> bytes;
+    uint64_t framesWritten = 0;
+
+    WavSink(const std::string& filename, double cyclesPerSecond, uint32_t sampleRate = SAMPLE_RATE)
+            : AudioSink(cyclesPerSecond, sampleRate), file(filename, std::ios::binary) {
+        if (!file) {
+            throw std::runtime_error("Failed to open " + filename);
+        }
+        // no device clock to chase: cycle 0 is sample 0 and nothing ever resyncs
+        synth.synced = true;
+        synth.latency = 0;
+        synth.maxDrift = std::numeric_limits<double>::infinity();
+        writeHeader(sampleRate);
+    }
+
+    ~WavSink() override {
+        // patch in the sizes now that we know them
+        uint32_t dataSize = (uint32_t)(framesWritten * 4);
+        file.seekp(4);
+        write32(36 + dataSize);
+        file.seekp(40);
+        write32(dataSize);
+    }
+
+    void flush(uint64_t cycle) override {
+        uint64_t target = (uint64_t)(cycle * synth.samplesPerCycle);
+        if (target <= framesWritten) return;
+        uint32_t frameCount = (uint32_t)(target - framesWritten);
+
+        buffer.resize(frameCount * 2);
+        bytes.resize(frameCount * 4);
+        synth.render(buffer.data(), frameCount);
+        for (size_t i = 0; i < buffer.size(); i++) {
+            uint16_t pcm = (uint16_t)(int16_t)std::clamp(buffer[i] * 32767.0f, -32768.0f, 32767.0f);
+            bytes[i * 2] = (char)(pcm & 0xFF);
+            bytes[i * 2 + 1] = (char)(pcm >> 8);
+        }
+        file.write(bytes.data(), bytes.size());
+        framesWritten = target;
+    }
+
+private:
+    void writeHeader(uint32_t sampleRate) {
+        file.write("RIFF", 4);
+        write32(36);            // patched on close
+        file.write("WAVEfmt ", 8);
+        write32(16);
+        write16(1);             // pcm
+        write16(2);             // channels
+        write32(sampleRate);
+        write32(sampleRate * 4);
+        write16(4);             // bytes per frame
+        write16(16);            // bits per sample
+        file.write("data", 4);
+        write32(0);             // patched on close
+    }
+
+    void write16(uint16_t v) {
+        char bytes[2] = {(char)(v & 0xFF), (char)(v >> 8)};
+        file.write(bytes, 2);
+    }
+
+    void write32(uint32_t v) {
+        write16(v & 0xFFFF);
+        write16(v >> 16);
     }
 };
 
@@ -0,0 +1,46 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// single producer / single consumer ring buffer. no locks, so it's safe to pop from the
+// real-time audio thread. N has to be a power of two
+template <typename T, size_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    // producer side, returns false (and drops the item) when full
+    bool push(const T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) == N) return false;
+        items[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, nullptr when empty. the item stays valid until pop()
+    const T* peek() const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) return nullptr;
+        return &items[tail & (N - 1)];
+    }
+
+    void pop() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, N> items{};
+    // producer and consumer indices on their own cache lines
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+#endif // SPSC_RING_H
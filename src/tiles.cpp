@@ -0,0 +1,123 @@
+#include "tiles.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+static size_t pickThreads(size_t requested, size_t machines) {
+    size_t threads = requested ? requested : std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(threads, machines));
+}
+
+TileGrid::TileGrid(std::vector<std::unique_ptr<Chip8>> machineList, size_t threads)
+    : machines(std::move(machineList)),
+      threadCount(pickThreads(threads, machines.size())),
+      start(threadCount + 1),
+      done(threadCount + 1) {
+    bool hires = std::any_of(machines.begin(), machines.end(), [](const std::unique_ptr<Chip8>& m) {
+        return m->quirks == QuirkProfile::SCHIP || m->quirks == QuirkProfile::XOCHIP;
+    });
+    tileWidth = hires ? Chip8::HIRES_WIDTH : Chip8::DISPLAY_WIDTH;
+    tileHeight = hires ? Chip8::HIRES_HEIGHT : Chip8::DISPLAY_HEIGHT;
+
+    // tiles are 2:1 like the screen, a square grid of them keeps the window 2:1 too
+    columns = std::max<size_t>(1, (size_t)std::ceil(std::sqrt((double)machines.size())));
+    rows = (machines.size() + columns - 1) / columns;
+    atlasWidth = columns * (tileWidth + GAP) - GAP;
+    atlasHeight = rows * (tileHeight + GAP) - GAP;
+    atlas.assign(atlasWidth * atlasHeight, BACKGROUND);
+
+    // everything shows up on the first upload, whether it draws in the first frame or not
+    dirty.assign(machines.size(), 1);
+    for (size_t tile = 0; tile < machines.size(); tile++) {
+        machines[tile]->displayChanged = false;
+        pack(tile);
+    }
+
+    packed.assign(threadCount, 0);
+    size_t perThread = (machines.size() + threadCount - 1) / threadCount;
+    for (size_t worker = 0; worker < threadCount; worker++) {
+        size_t first = std::min(machines.size(), worker * perThread);
+        size_t end = std::min(machines.size(), first + perThread);
+        workers.emplace_back(&TileGrid::work, this, worker, first, end);
+    }
+}
+
+TileGrid::~TileGrid() {
+    stopping = true;
+    start.arrive_and_wait();
+    for (std::thread& worker : workers) worker.join();
+}
+
+void TileGrid::runFrame(uint16_t keys) {
+    keypad = keys;
+    start.arrive_and_wait();
+    done.arrive_and_wait();
+    frames++;
+    for (uint64_t& count : packed) {
+        packedTiles += count;
+        count = 0;
+    }
+}
+
+void TileGrid::work(size_t worker, size_t first, size_t end) {
+    while (true) {
+        start.arrive_and_wait();
+        if (stopping) return;
+        for (size_t tile = first; tile < end; tile++) {
+            Chip8& machine = *machines[tile];
+            machine.keypad = keypad;
+            machine.runFrame();
+            machine.tickTimers();
+            if (!machine.displayChanged) continue;
+            machine.displayChanged = false;
+            pack(tile);
+            dirty[tile] = 1;
+            packed[worker]++;
+        }
+        done.arrive_and_wait();
+    }
+}
+
+void TileGrid::pack(size_t tile) {
+    const Display& display = machines[tile]->presented();
+    size_t scale = tileWidth / display.width;
+    uint32_t* origin = &atlas[(tile / columns) * (tileHeight + GAP) * atlasWidth + (tile % columns) * (tileWidth + GAP)];
+
+    for (size_t y = 0; y < display.height; y++) {
+        Display::Row plane0 = display.row(y, 0);
+        Display::Row plane1 = display.row(y, 1);
+        uint32_t* line = origin + y * scale * atlasWidth;
+        for (size_t x = 0; x < display.width; x++) {
+            int shift = Display::MAX_WIDTH - 1 - x;
+            uint32_t color = Display::PALETTE[((plane0 >> shift) & 1) | (((plane1 >> shift) & 1) << 1)];
+            for (size_t dx = 0; dx < scale; dx++) line[x * scale + dx] = color;
+        }
+        for (size_t dy = 1; dy < scale; dy++) {
+            std::copy(line, line + tileWidth, line + dy * atlasWidth);
+        }
+    }
+}
+
+std::pair<size_t, size_t> TileGrid::dirtySpan() const {
+    size_t firstRow = rows;
+    size_t lastRow = 0;
+    for (size_t tile = 0; tile < dirty.size(); tile++) {
+        if (!dirty[tile]) continue;
+        firstRow = std::min(firstRow, tile / columns);
+        lastRow = std::max(lastRow, tile / columns);
+    }
+    if (firstRow == rows) return {0, 0};
+    return {firstRow * (tileHeight + GAP), lastRow * (tileHeight + GAP) + tileHeight};
+}
+
+void TileGrid::clearDirty() {
+    std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+void TileGrid::printReport() const {
+    if (frames == 0) return;
+    std::cout << "Grid: " << machines.size() << " machines on " << threadCount << " threads, "
+              << frames << " frames, " << std::fixed << std::setprecision(1)
+              << (double)packedTiles / frames << " tiles redrawn per frame" << std::endl;
+}
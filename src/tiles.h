@@ -0,0 +1,71 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <atomic>
+#include <barrier>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "definitions.h"
+
+// --grid N: many machines running side by side in one window, for keeping an eye on batch
+// runs. worker threads each own a slice of the machines. after a frame every machine that
+// drew packs its screen into its own tile of a shared rgba atlas and flags the tile dirty,
+// the ones that didn't draw cost nothing past running the frame. the gui uploads the rows
+// covering the dirty tiles with one texture update and copies the atlas into the window
+class TileGrid {
+public:
+    // between tiles, in the atlas background color
+    static constexpr size_t GAP = 1;
+    static constexpr uint32_t BACKGROUND = 0x303030FF;
+
+    // threads = 0 picks one per hardware thread, never more than there are machines
+    TileGrid(std::vector<std::unique_ptr<Chip8>> machines, size_t threads = 0);
+    ~TileGrid();
+    TileGrid(const TileGrid&) = delete;
+    TileGrid& operator=(const TileGrid&) = delete;
+
+    // one emulated frame on every machine, all get the same keys. returns once every
+    // tile is packed, the atlas is only touched while this runs
+    void runFrame(uint16_t keypad);
+
+    // atlas rows [first, end) covering all dirty tiles, first == end when nothing changed
+    std::pair<size_t, size_t> dirtySpan() const;
+    void clearDirty();
+
+    void printReport() const;
+
+    std::vector<std::unique_ptr<Chip8>> machines;
+    // lores tiles unless one of the machines can switch to hires, lores screens on hires
+    // tiles are drawn at 2x so every tile looks the same
+    size_t tileWidth;
+    size_t tileHeight;
+    size_t columns;
+    size_t rows;
+    size_t atlasWidth;
+    size_t atlasHeight;
+    std::vector<uint32_t> atlas;
+    // per machine, written by its worker, read and cleared by the gui between frames
+    std::vector<uint8_t> dirty;
+
+    uint64_t frames = 0;
+    uint64_t packedTiles = 0;
+
+private:
+    size_t threadCount;
+    std::barrier<> start;
+    std::barrier<> done;
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+    uint16_t keypad = 0;
+    // per worker, summed into packedTiles after each frame
+    std::vector<uint64_t> packed;
+
+    void work(size_t worker, size_t first, size_t end);
+    void pack(size_t tile);
+};
+
+#endif // TILES_H
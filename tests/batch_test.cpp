@@ -0,0 +1,49 @@
+// Chip8Batch fetches once per run of lanes at the same pc. code outside what the analysis
+// found (here built at runtime and reached through BNNN) can differ per lane, every lane
+// has to run its own bytes there
+#include <memory>
+
+#include "batch.h"
+#include "check.h"
+#include "definitions.h"
+
+int main() {
+    // 200: 6061  V0 = 61, opcode high byte of 61NN
+    // 202: 6105  V1 = 05
+    // 204: E39E  skip if key V3 (0) is held
+    // 206: 120A
+    // 208: 6107  V1 = 07, only lanes holding key 0
+    // 20A: A300
+    // 20C: F155  300: 61 05 or 61 07
+    // 20E: 6202  V2 = 2
+    // 210: B2FE  jump to 2FE + V2 (chip48 adds VX), the analysis only sees 2FE
+    // 2FE: 12FE
+    // 300: ....  V1 = 05 + 10 or 07 + 10, built above
+    // 302: 71 10
+    // 304: 1304  spin
+    auto chip8 = std::make_unique<Chip8>();
+    chip8->setQuirks(QuirkProfile::CHIP48);
+    chip8->v_reg.fill(0);
+    const uint8_t code[] = {0x60, 0x61, 0x61, 0x05, 0xE3, 0x9E, 0x12, 0x0A, 0x61, 0x07,
+                            0xA3, 0x00, 0xF1, 0x55, 0x62, 0x02, 0xB2, 0xFE};
+    for (size_t i = 0; i < sizeof(code); i++) chip8->ram[0x200 + i] = code[i];
+    const uint8_t tail[] = {0x12, 0xFE, 0x00, 0x00, 0x71, 0x10, 0x13, 0x04};
+    for (size_t i = 0; i < sizeof(tail); i++) chip8->ram[0x2FE + i] = tail[i];
+    chip8->translate(analyzeRom(chip8->ram, 0x200, QuirkProfile::CHIP48));
+
+    Chip8Batch batch(*chip8, 4);
+    batch.keypad[1] = 1 << 0;
+    batch.keypad[3] = 1 << 0;
+    batch.runCycles(16);
+
+    for (size_t lane = 0; lane < 4; lane++) {
+        CHECK(batch.pc[lane] == 0x304);
+        CHECK(batch.v[1][lane] == (batch.keypad[lane] ? 0x17 : 0x15));
+    }
+    // back in step on the spin
+    uint64_t lockstep = batch.lockstepSteps;
+    batch.runCycles(4);
+    CHECK(batch.lockstepSteps == lockstep + 4);
+
+    return checkFailures;
+}
@@ -0,0 +1,84 @@
+// frame blending: a sprite xor-ed on and off every frame flickers on the raw display, with
+// --blend or it's steadily on and the core stops reporting display changes. a redraw the
+// gui still owes survives the frame, and so does a resolution switch on a blank screen
+#include <memory>
+#include <vector>
+
+#include "check.h"
+#include "definitions.h"
+
+static std::unique_ptr<Chip8> machine(const std::vector<uint8_t>& rom, QuirkProfile profile,
+                                      FrameBlend::Mode mode) {
+    auto chip8 = std::make_unique<Chip8>();
+    chip8->setQuirks(profile);
+    chip8->clock = ClockModel::instructionsPerFrame(2);
+    chip8->v_reg.fill(0);
+    chip8->loadFonts(*chip8, chip8->ram);
+    for (size_t i = 0; i < rom.size(); i++) chip8->ram[0x200 + i] = rom[i];
+    chip8->translate(analyzeRom(chip8->ram, 0x200, profile));
+    chip8->blend.mode = mode;
+    chip8->blend.depth = 2;
+    return chip8;
+}
+
+static std::unique_ptr<Chip8> flicker(FrameBlend::Mode mode) {
+    // 200: A050  I = font digit 0
+    // 202: D005  xor it at 0,0
+    // 204: 1202  and again, one draw per frame at 2 instructions a frame
+    return machine({0xA0, 0x50, 0xD0, 0x05, 0x12, 0x02}, QuirkProfile::CHIP48, mode);
+}
+
+int main() {
+    {
+        auto chip8 = flicker(FrameBlend::Mode::OFF);
+        for (int frame = 0; frame < 8; frame++) {
+            chip8->displayChanged = false;
+            chip8->runFrame();
+            // every frame draws, so every frame is a change
+            CHECK(chip8->displayChanged);
+            CHECK(chip8->display.get(0, 0) == (frame % 2 == 0));
+        }
+    }
+    {
+        auto chip8 = flicker(FrameBlend::Mode::OR);
+        for (int frame = 0; frame < 3; frame++) chip8->runFrame();
+        for (int frame = 3; frame < 32; frame++) {
+            chip8->displayChanged = false;
+            chip8->runFrame();
+            // the raw display still flickers
+            CHECK(chip8->display.get(0, 0) == (frame % 2 == 0));
+            // the blended one doesn't, so nothing needs presenting
+            CHECK(!chip8->displayChanged);
+            CHECK(chip8->presented().get(0, 0));
+        }
+
+        // the gui held a frame back or the window was exposed: the flag is still set going
+        // into a frame whose blended image doesn't change, and has to stay set
+        chip8->displayChanged = true;
+        chip8->runFrame();
+        CHECK(chip8->displayChanged);
+        chip8->displayChanged = false;
+        chip8->runFrame();
+        CHECK(!chip8->displayChanged);
+    }
+    {
+        // 200: 6000  two frames of nothing drawn in lores
+        // 202: 6000
+        // 204: 00FF  hires, still nothing drawn
+        // 206: 1206  spin
+        auto chip8 = machine({0x60, 0x00, 0x60, 0x00, 0x00, 0xFF, 0x12, 0x06}, QuirkProfile::SCHIP,
+                             FrameBlend::Mode::OR);
+        chip8->displayChanged = false;
+        chip8->runFrame();
+        CHECK(!chip8->displayChanged);
+        // the switch clears the blended output, a change even though both frames are blank
+        chip8->runFrame();
+        CHECK(chip8->display.hires);
+        CHECK(chip8->presented().hires);
+        CHECK(chip8->displayChanged);
+        chip8->displayChanged = false;
+        chip8->runFrame();
+        CHECK(!chip8->displayChanged);
+    }
+    return checkFailures;
+}
@@ -0,0 +1,18 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+// tiny assert for the core tests: reports the failing line and carries on, main returns
+// the number of failures so ctest sees anything but 0 as failed
+inline int checkFailures = 0;
+
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n";  \
+            checkFailures++;                                                            \
+        }                                                                               \
+    } while (0)
+
+#endif // CHECK_H
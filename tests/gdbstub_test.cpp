@@ -0,0 +1,117 @@
+// talks rsp to a GdbStub over a local socket and checks the target description it serves
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "debugger.h"
+#include "definitions.h"
+#include "gdbstub.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+using Socket = SOCKET;
+static const std::string WHERE = "50123";
+#else
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+using Socket = int;
+static const std::string WHERE = "/tmp/chip8-gdbstub-test.sock";
+#endif
+
+static Socket connectStub() {
+#ifdef _WIN32
+    Socket s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)std::stoi(WHERE));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+#else
+    Socket s = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", WHERE.c_str());
+#endif
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) return (Socket)-1;
+    return s;
+}
+
+static void sendPacket(Socket s, const std::string& payload) {
+    uint8_t sum = 0;
+    for (char c : payload) sum += (uint8_t)c;
+    char tail[4];
+    snprintf(tail, sizeof(tail), "#%02x", sum);
+    std::string packet = "$" + payload + tail;
+    send(s, packet.data(), (int)packet.size(), 0);
+}
+
+// the payload of the next reply, acks skipped
+static std::string readReply(Socket s) {
+    std::string data;
+    char c;
+    while (recv(s, &c, 1, 0) == 1 && c != '$') {}
+    while (recv(s, &c, 1, 0) == 1 && c != '#') data += c;
+    recv(s, &c, 1, 0);
+    recv(s, &c, 1, 0);
+    send(s, "+", 1, 0);
+    return data;
+}
+
+static std::string query(Socket s, const std::string& payload) {
+    sendPacket(s, payload);
+    return readReply(s);
+}
+
+int main() {
+    auto chip8 = std::make_unique<Chip8>();
+    chip8->setQuirks(QuirkProfile::CHIP48);
+    Debugger debugger(*chip8);
+    GdbStub stub(*chip8, debugger);
+    if (!stub.listen(WHERE)) return 1;
+    std::thread server([&] { stub.serve(); });
+
+    Socket s = connectStub();
+    CHECK(s != (Socket)-1);
+    if (s != (Socket)-1) {
+        CHECK(query(s, "qSupported:xmlRegisters=i386").find("qXfer:features:read+") != std::string::npos);
+
+        // the whole description in one go
+        std::string xml = query(s, "qXfer:features:read:target.xml:0,fff");
+        CHECK(!xml.empty() && xml[0] == 'l');
+        CHECK(xml.find("<reg name=\"v0\" bitsize=\"8\" regnum=\"0\"") != std::string::npos);
+        CHECK(xml.find("<reg name=\"vf\" bitsize=\"8\"") != std::string::npos);
+        CHECK(xml.find("<reg name=\"i\" bitsize=\"16\"") != std::string::npos);
+        CHECK(xml.find("<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"") != std::string::npos);
+        CHECK(xml.find("<reg name=\"sp\" bitsize=\"16\"") != std::string::npos);
+        CHECK(xml.find("<reg name=\"dt\" bitsize=\"8\"") != std::string::npos);
+        CHECK(xml.find("<reg name=\"st\" bitsize=\"8\"") != std::string::npos);
+        // same order as the g packet
+        CHECK(xml.find("name=\"vf\"") < xml.find("name=\"i\""));
+        CHECK(xml.find("name=\"i\"") < xml.find("name=\"pc\""));
+        CHECK(xml.find("name=\"pc\"") < xml.find("name=\"sp\""));
+        CHECK(xml.find("name=\"sp\"") < xml.find("name=\"dt\""));
+        CHECK(xml.find("name=\"dt\"") < xml.find("name=\"st\""));
+
+        // in chunks, the pieces put together are the same document
+        std::string joined;
+        for (size_t offset = 0;; offset += 64) {
+            char args[64];
+            snprintf(args, sizeof(args), "qXfer:features:read:target.xml:%zx,40", offset);
+            std::string chunk = query(s, args);
+            CHECK(!chunk.empty() && (chunk[0] == 'm' || chunk[0] == 'l'));
+            if (chunk.empty()) break;
+            joined += chunk.substr(1);
+            if (chunk[0] == 'l') break;
+        }
+        CHECK(joined == xml.substr(1));
+
+        CHECK(query(s, "qXfer:features:read:other.xml:0,fff")[0] == 'E');
+        sendPacket(s, "k");
+    }
+    server.join();
+    return checkFailures;
+}